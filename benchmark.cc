@@ -0,0 +1,859 @@
+// Benchmarks of the public operations of Datastructures on synthetic networks, which check the estimates of
+// performance of datastructures.hh. Needs Google Benchmark and is built and run with
+//
+//   g++ -std=c++17 -O2 -DNDEBUG benchmark.cc datastructures.cc -lbenchmark -pthread -o benchmark
+//   ./benchmark --benchmark_format=json --benchmark_out=bench_output.txt --benchmark_out_format=json
+//
+// Every operation is run on a grid, a scale-free and a timetable network of n = 10^3...10^6 stations. The
+// n of each run is its complexity_n, so the JSON also has the complexity fitted over the sizes as the _BigO and
+// _RMS entries of every benchmark. --max_stations=<n> lowers the largest size and --benchmark_filter=<regex>
+// picks the operations or the networks, for example --benchmark_filter=route_.*/grid. The networks of 10^6
+// stations take up to 3 GB of memory and the benchmarks building their own Datastructures twice that.
+
+#include "datastructures.hh"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Distance between neighbouring stations of a grid
+int const SPACING = 100;
+// Stations of a region of the region tree, which isn't split further
+std::size_t const REGION_STATIONS = 16;
+// Queries picked at random before a benchmark and cycled through
+std::size_t const QUERY_COUNT = 1024;
+
+std::size_t max_stations = 1000000;
+
+enum class Network { grid, scale_free, timetable };
+
+char const* network_name(Network network) {
+    switch (network) {
+        case Network::grid:
+            return "grid";
+        case Network::scale_free:
+            return "scale_free";
+        case Network::timetable:
+            return "timetable";
+    }
+    return "";
+}
+
+using Stops = std::vector<std::pair<StationID, Time>>;
+
+// Stations, regions and trains of a network, which are added to a Datastructures by the benchmarks
+struct NetworkData {
+    std::vector<std::tuple<StationID, Name, Coord>> stations;
+    // Regions of the region tree, parents before their subregions, and the subregions with their parents
+    std::vector<std::tuple<RegionID, Name, std::vector<Coord>>> regions;
+    std::vector<std::pair<RegionID, RegionID>> subregions;
+    // Every station is in the leaf region it is located in
+    std::vector<std::pair<StationID, RegionID>> station_regions;
+    std::vector<std::pair<TrainID, Stops>> trains;
+    int side = 0;
+};
+
+/**
+ * @brief hhmm converts minutes from midnight to Time, which is in HHMM
+ * @param minutes the minutes, less than 24 * 60
+ * @return the Time
+ */
+Time hhmm(int minutes) {
+    return (Time)(minutes / 60 * 100 + minutes % 60);
+}
+
+/**
+ * @brief travel_minutes returns the minutes a train takes between two stations, one per SPACING
+ * @param a Coord of the first station
+ * @param b Coord of the second station
+ * @return the minutes, from one to an hour
+ */
+int travel_minutes(Coord a, Coord b) {
+    return std::min(60, std::max(1, (int)(std::sqrt((double)squared_distance(a, b)) / SPACING)));
+}
+
+/**
+ * @brief add_trains_along adds trains along the stations of a line, starting at the given minutes and in
+ *        both directions, so that they run between 5:00 and 24:00 as far as they can
+ * @param data NetworkData where the trains are added to
+ * @param line indexes of the stations of the line
+ * @param starts the minutes the trains leave the ends of the line
+ */
+void add_trains_along(NetworkData& data, std::vector<std::size_t> const& line, std::vector<int> const& starts) {
+    for (int direction = 0; direction < 2; direction++) {
+        for (std::vector<int>::const_iterator start = starts.begin(); start != starts.end(); start++) {
+            Stops stops;
+            int minutes = *start;
+            for (std::size_t k = 0; k < line.size() && minutes < 24 * 60; k++) {
+                std::size_t i = direction == 0 ? line[k] : line[line.size() - 1 - k];
+                if (!stops.empty()) {
+                    std::size_t p = direction == 0 ? line[k - 1] : line[line.size() - k];
+                    minutes += travel_minutes(std::get<2>(data.stations[p]), std::get<2>(data.stations[i]));
+                    if (minutes >= 24 * 60) {
+                        break;
+                    }
+                }
+                stops.emplace_back(std::get<0>(data.stations[i]), hhmm(minutes));
+            }
+            if (stops.size() >= 2) {
+                data.trains.emplace_back("T" + std::to_string(data.trains.size()), std::move(stops));
+            }
+        }
+    }
+}
+
+/**
+ * @brief add_region_tree splits the area of the stations into a quadtree of rectangular regions until a region
+ *        has about REGION_STATIONS stations and puts every station to the leaf region it is located in
+ * @param data NetworkData with the stations, where the regions are added to
+ */
+void add_region_tree(NetworkData& data) {
+    std::size_t leaves = 1;
+    while (leaves * REGION_STATIONS < data.stations.size()) {
+        leaves *= 4;
+    }
+    int cells = (int)std::sqrt((double)leaves);
+    int extent = data.side * SPACING;
+    // The leaf regions by their cells
+    std::map<std::pair<int, int>, RegionID> leaf;
+    std::function<void(int, int, int, RegionID)> add = [&](int x, int y, int size, RegionID parent) {
+        RegionID id = data.regions.size() + 1;
+        int x1 = (int)((long long)x * extent / cells);
+        int y1 = (int)((long long)y * extent / cells);
+        int x2 = (int)((long long)(x + size) * extent / cells);
+        int y2 = (int)((long long)(y + size) * extent / cells);
+        data.regions.emplace_back(id, "R" + std::to_string(id), std::vector<Coord>{{x1, y1}, {x2, y1}, {x2, y2}, {x1, y2}});
+        if (parent != NO_REGION) {
+            data.subregions.emplace_back(id, parent);
+        }
+        if (size == 1) {
+            leaf[{x, y}] = id;
+            return;
+        }
+        int half = size / 2;
+        add(x, y, half, id);
+        add(x + half, y, half, id);
+        add(x, y + half, half, id);
+        add(x + half, y + half, half, id);
+    };
+    add(0, 0, cells, NO_REGION);
+    for (std::vector<std::tuple<StationID, Name, Coord>>::const_iterator it = data.stations.begin();
+         it != data.stations.end(); it++) {
+        Coord xy = std::get<2>(*it);
+        int cx = std::min(cells - 1, (int)((long long)xy.x * cells / extent));
+        int cy = std::min(cells - 1, (int)((long long)xy.y * cells / extent));
+        data.station_regions.emplace_back(std::get<0>(*it), leaf[{cx, cy}]);
+    }
+}
+
+/**
+ * @brief add_grid_stations places n stations on a square grid with random names
+ * @param data NetworkData where the stations are added to
+ * @param n the number of stations
+ * @param random the random generator
+ */
+void add_grid_stations(NetworkData& data, std::size_t n, std::mt19937& random) {
+    data.side = (int)std::ceil(std::sqrt((double)n));
+    std::uniform_int_distribution<int> letter('a', 'z');
+    for (std::size_t i = 0; i < n; i++) {
+        Name name(8, 'a');
+        for (std::string::iterator c = name.begin(); c != name.end(); c++) {
+            *c = (char)letter(random);
+        }
+        Coord xy{(int)(i % data.side) * SPACING, (int)(i / data.side) * SPACING};
+        data.stations.emplace_back("S" + std::to_string(i), std::move(name), xy);
+    }
+}
+
+/**
+ * @brief grid_network generates stations on a square grid with a train in both directions along every row
+ *        and every column, so every station has four next stations except on the edges
+ * @param n the number of stations
+ * @return the NetworkData
+ */
+NetworkData grid_network(std::size_t n) {
+    std::mt19937 random(1);
+    NetworkData data;
+    add_grid_stations(data, n, random);
+    std::uniform_int_distribution<int> start(5 * 60, 8 * 60);
+    for (int row = 0; row < data.side; row++) {
+        std::vector<std::size_t> line;
+        for (std::size_t i = (std::size_t)row * data.side; i < std::min(n, (std::size_t)(row + 1) * data.side); i++) {
+            line.push_back(i);
+        }
+        add_trains_along(data, line, {start(random)});
+    }
+    for (int column = 0; column < data.side; column++) {
+        std::vector<std::size_t> line;
+        for (std::size_t i = column; i < n; i += data.side) {
+            line.push_back(i);
+        }
+        add_trains_along(data, line, {start(random)});
+    }
+    add_region_tree(data);
+    return data;
+}
+
+/**
+ * @brief scale_free_network generates stations at random positions connected by preferential attachment, so
+ *        that the number of next stations follows a power law like in a network of hubs. Every station
+ *        is connected to two earlier stations picked in proportion to their connections. A train runs once
+ *        a day in both directions between every station and the first station it was connected to, so all of
+ *        them are connected, and the longer trains are random walks of ten stations over the connections.
+ * @param n the number of stations
+ * @return the NetworkData
+ */
+NetworkData scale_free_network(std::size_t n) {
+    std::mt19937 random(2);
+    NetworkData data;
+    add_grid_stations(data, n, random);
+    std::uniform_int_distribution<int> position(0, data.side * SPACING - 1);
+    for (std::vector<std::tuple<StationID, Name, Coord>>::iterator it = data.stations.begin(); it != data.stations.end(); it++) {
+        std::get<2>(*it) = Coord{position(random), position(random)};
+    }
+    // Every connection is in ends twice, once by each of its stations, so a random entry is a station picked
+    // in proportion to its connections
+    std::vector<std::size_t> ends;
+    std::vector<std::vector<std::size_t>> next(n);
+    for (std::size_t i = 1; i < n; i++) {
+        for (int k = 0; k < 2 && (k == 0 || i > 1); k++) {
+            std::size_t j = ends.empty() ? 0 : ends[std::uniform_int_distribution<std::size_t>(0, ends.size() - 1)(random)];
+            if (std::find(next[i].begin(), next[i].end(), j) != next[i].end()) {
+                continue;
+            }
+            next[i].push_back(j);
+            next[j].push_back(i);
+            ends.push_back(i);
+            ends.push_back(j);
+        }
+    }
+    std::uniform_int_distribution<std::size_t> station(0, n - 1);
+    std::uniform_int_distribution<int> start(5 * 60, 20 * 60);
+    for (std::size_t i = 1; i < n; i++) {
+        add_trains_along(data, {next[i].front(), i}, {start(random)});
+    }
+    for (std::size_t t = 0; t < n / 5; t++) {
+        std::vector<std::size_t> line{station(random)};
+        while (line.size() < 10) {
+            std::vector<std::size_t> const& choices = next[line.back()];
+            std::size_t j = choices[std::uniform_int_distribution<std::size_t>(0, choices.size() - 1)(random)];
+            if (std::find(line.begin(), line.end(), j) != line.end()) {
+                break;
+            }
+            line.push_back(j);
+        }
+        add_trains_along(data, line, {start(random)});
+    }
+    add_region_tree(data);
+    return data;
+}
+
+/**
+ * @brief timetable_network generates stations on a jittered grid with lines of 10 to 30 stations, which mostly
+ *        go straight and sometimes turn, like regional railways. Each line has trains in both directions every
+ *        four to eight hours from the morning, which gives each station about ten departures a day.
+ * @param n the number of stations
+ * @return the NetworkData
+ */
+NetworkData timetable_network(std::size_t n) {
+    std::mt19937 random(3);
+    NetworkData data;
+    add_grid_stations(data, n, random);
+    std::uniform_int_distribution<int> jitter(-SPACING / 3, SPACING / 3);
+    for (std::vector<std::tuple<StationID, Name, Coord>>::iterator it = data.stations.begin(); it != data.stations.end(); it++) {
+        Coord& xy = std::get<2>(*it);
+        xy = Coord{std::max(0, xy.x + jitter(random)), std::max(0, xy.y + jitter(random))};
+    }
+    int const dx[] = {1, 0, -1, 0};
+    int const dy[] = {0, 1, 0, -1};
+    std::uniform_int_distribution<std::size_t> station(0, n - 1);
+    std::uniform_int_distribution<int> direction(0, 3);
+    std::uniform_int_distribution<int> length(10, 30);
+    std::uniform_int_distribution<int> turn(0, 5);
+    std::uniform_int_distribution<int> headway(240, 480);
+    std::uniform_int_distribution<int> first(5 * 60, 7 * 60);
+    for (std::size_t l = 0; l < n / 10; l++) {
+        std::size_t i = station(random);
+        int d = direction(random);
+        std::vector<std::size_t> line{i};
+        for (int k = length(random); (int)line.size() < k;) {
+            if (turn(random) == 0) {
+                d = (d + (turn(random) < 3 ? 1 : 3)) % 4;
+            }
+            long long x = (long long)(i % data.side) + dx[d];
+            long long y = (long long)(i / data.side) + dy[d];
+            std::size_t j = (std::size_t)(y * data.side + x);
+            if (x < 0 || y < 0 || x >= data.side || j >= n || std::find(line.begin(), line.end(), j) != line.end()) {
+                break;
+            }
+            line.push_back(j);
+            i = j;
+        }
+        std::vector<int> starts;
+        int step = headway(random);
+        for (int minutes = first(random); minutes < 21 * 60; minutes += step) {
+            starts.push_back(minutes);
+        }
+        add_trains_along(data, line, starts);
+    }
+    add_region_tree(data);
+    return data;
+}
+
+/**
+ * @brief generate_network generates the given network
+ * @param network the kind of the network
+ * @param n the number of stations
+ * @return the NetworkData
+ */
+NetworkData generate_network(Network network, std::size_t n) {
+    switch (network) {
+        case Network::grid:
+            return grid_network(n);
+        case Network::scale_free:
+            return scale_free_network(n);
+        case Network::timetable:
+            return timetable_network(n);
+    }
+    return {};
+}
+
+/**
+ * @brief add_stations adds the stations of a network to datastructures
+ * @param ds the Datastructures
+ * @param data the NetworkData
+ */
+void add_stations(Datastructures& ds, NetworkData const& data) {
+    ds.add_stations(data.stations);
+}
+
+/**
+ * @brief add_regions adds the regions of a network to datastructures and the stations to them
+ * @param ds the Datastructures, which has the stations
+ * @param data the NetworkData
+ */
+void add_regions(Datastructures& ds, NetworkData const& data) {
+    for (std::vector<std::tuple<RegionID, Name, std::vector<Coord>>>::const_iterator it = data.regions.begin();
+         it != data.regions.end(); it++) {
+        ds.add_region(std::get<0>(*it), std::get<1>(*it), std::get<2>(*it));
+    }
+    for (std::vector<std::pair<RegionID, RegionID>>::const_iterator it = data.subregions.begin(); it != data.subregions.end(); it++) {
+        ds.add_subregion_to_region(it->first, it->second);
+    }
+    for (std::vector<std::pair<StationID, RegionID>>::const_iterator it = data.station_regions.begin();
+         it != data.station_regions.end(); it++) {
+        ds.add_station_to_region(it->first, it->second);
+    }
+}
+
+/**
+ * @brief add_network adds the stations, the regions and the trains of a network to datastructures
+ * @param ds the empty Datastructures
+ * @param data the NetworkData
+ */
+void add_network(Datastructures& ds, NetworkData const& data) {
+    add_stations(ds, data);
+    add_regions(ds, data);
+    ds.add_trains(data.trains);
+}
+
+// A generated network and a Datastructures with all of it, shared by the benchmarks, which don't change it or
+// change it back
+struct Fixture {
+    NetworkData data;
+    std::unique_ptr<Datastructures> ds;
+};
+
+/**
+ * @brief fixture returns the Fixture of the given network, generating it when needed. Only the networks of one
+ *        kind are kept at a time, since the benchmarks of a kind are run together. The benchmarks, which build
+ *        their own Datastructures, are run last and drop the shared one, so at most two of them are in memory.
+ * @param network the kind of the network
+ * @param n the number of stations
+ * @param shared whether the Fixture needs the shared Datastructures or only the NetworkData
+ * @return the Fixture
+ */
+Fixture& fixture(Network network, std::size_t n, bool shared) {
+    static std::map<std::pair<Network, std::size_t>, std::unique_ptr<Fixture>> fixtures;
+    for (std::map<std::pair<Network, std::size_t>, std::unique_ptr<Fixture>>::iterator it = fixtures.begin(); it != fixtures.end();) {
+        if (it->first.first != network) {
+            it = fixtures.erase(it);
+        } else {
+            it++;
+        }
+    }
+    std::unique_ptr<Fixture>& found = fixtures[{network, n}];
+    if (!found) {
+        found = std::make_unique<Fixture>();
+        found->data = generate_network(network, n);
+    }
+    if (shared && !found->ds) {
+        found->ds = std::make_unique<Datastructures>();
+        add_network(*found->ds, found->data);
+    } else if (!shared) {
+        found->ds.reset();
+    }
+    return *found;
+}
+
+/**
+ * @brief random_indexes picks QUERY_COUNT random indexes for the queries of a benchmark
+ * @param n the number of indexes to pick from
+ * @param seed seed of the random generator
+ * @return the indexes
+ */
+std::vector<std::size_t> random_indexes(std::size_t n, unsigned int seed) {
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<std::size_t> index(0, n - 1);
+    std::vector<std::size_t> result(QUERY_COUNT);
+    for (std::vector<std::size_t>::iterator it = result.begin(); it != result.end(); it++) {
+        *it = index(random);
+    }
+    return result;
+}
+
+// A benchmark, which gets the network and the number of its stations
+using Benchmark = std::function<void(benchmark::State&, Network, std::size_t)>;
+
+/**
+ * @brief station_query returns a Benchmark, which calls an operation of the shared Datastructures with a random
+ *        station of the network ie. its index in the stations at a time
+ * @param call the operation
+ * @return the Benchmark
+ */
+Benchmark station_query(std::function<void(Fixture&, std::size_t)> call) {
+    return [call](benchmark::State& state, Network network, std::size_t n) {
+        Fixture& f = fixture(network, n, true);
+        std::vector<std::size_t> queries = random_indexes(f.data.stations.size(), 4);
+        // The first call rebuilds what was left to be rebuilt lazily, which isn't measured
+        call(f, queries[0]);
+        std::size_t q = 0;
+        for (auto _ : state) {
+            call(f, queries[q]);
+            q = (q + 1) % QUERY_COUNT;
+        }
+    };
+}
+
+/**
+ * @brief pair_query returns a Benchmark, which calls an operation of the shared Datastructures with two random
+ *        stations of the network at a time
+ * @param call the operation, which gets the indexes of the stations and the number of the query
+ * @return the Benchmark
+ */
+Benchmark pair_query(std::function<void(Fixture&, std::size_t, std::size_t, std::size_t)> call) {
+    return [call](benchmark::State& state, Network network, std::size_t n) {
+        Fixture& f = fixture(network, n, true);
+        std::vector<std::size_t> from = random_indexes(f.data.stations.size(), 5);
+        std::vector<std::size_t> to = random_indexes(f.data.stations.size(), 6);
+        call(f, from[0], to[0], 0);
+        std::size_t q = 0;
+        for (auto _ : state) {
+            call(f, from[q], to[q], q);
+            q = (q + 1) % QUERY_COUNT;
+        }
+    };
+}
+
+/**
+ * @brief configured returns a Benchmark, which runs another one with the search direction and the timetable
+ *        engine of the shared Datastructures set and sets them back to the defaults afterwards. They are set
+ *        outside of the measured loop, since changing them invalidates the cached results and the lazily built
+ *        routes of the timetable.
+ * @param direction the SearchDirection
+ * @param engine the TimetableEngine
+ * @param run the Benchmark
+ * @return the Benchmark
+ */
+Benchmark configured(SearchDirection direction, TimetableEngine engine, Benchmark run) {
+    return [direction, engine, run](benchmark::State& state, Network network, std::size_t n) {
+        Datastructures& ds = *fixture(network, n, true).ds;
+        ds.set_search_direction(direction);
+        ds.set_timetable_engine(engine);
+        run(state, network, n);
+        ds.set_search_direction(SearchDirection::forward);
+        ds.set_timetable_engine(TimetableEngine::dijkstra);
+    };
+}
+
+/**
+ * @brief build returns a Benchmark, which adds the network from the start to an empty Datastructures in each
+ *        iteration and measures only the operations of the given part. The Datastructures is set up and
+ *        destroyed without measuring.
+ * @param setup adds what the measured part needs
+ * @param measured adds the measured part and returns the number of operations it called
+ * @return the Benchmark
+ */
+Benchmark build(std::function<void(Datastructures&, NetworkData const&)> setup,
+                std::function<std::size_t(Datastructures&, NetworkData const&)> measured) {
+    return [setup, measured](benchmark::State& state, Network network, std::size_t n) {
+        NetworkData const& data = fixture(network, n, false).data;
+        std::size_t operations = 0;
+        for (auto _ : state) {
+            state.PauseTiming();
+            std::unique_ptr<Datastructures> ds = std::make_unique<Datastructures>();
+            setup(*ds, data);
+            state.ResumeTiming();
+            operations += measured(*ds, data);
+            state.PauseTiming();
+            ds.reset();
+            state.ResumeTiming();
+        }
+        state.SetItemsProcessed((std::int64_t)operations);
+    };
+}
+
+/**
+ * @brief no_setup is the setup of a build, which starts from an empty Datastructures
+ */
+void no_setup(Datastructures&, NetworkData const&) {
+}
+
+/**
+ * @brief add_stations_and_regions adds the stations and the regions of a network
+ * @param ds the empty Datastructures
+ * @param data the NetworkData
+ */
+void add_stations_and_regions(Datastructures& ds, NetworkData const& data) {
+    add_stations(ds, data);
+    add_regions(ds, data);
+}
+
+/**
+ * @brief station_id returns the StationID of a station of the shared network
+ * @param f the Fixture
+ * @param i index of the station in the stations of the network
+ * @return the StationID
+ */
+StationID const& station_id(Fixture const& f, std::size_t i) {
+    return std::get<0>(f.data.stations[i]);
+}
+
+/**
+ * @brief region_id returns the RegionID of the leaf region of a station of the shared network
+ * @param f the Fixture
+ * @param i index of the station in the stations of the network
+ * @return the RegionID
+ */
+RegionID region_id(Fixture const& f, std::size_t i) {
+    return f.data.station_regions[i].second;
+}
+
+// A benchmark by the name of the operation it measures and whether it builds its own Datastructures
+struct Operation {
+    Operation(std::string name, Benchmark run) : name(std::move(name)), run(std::move(run)) {}
+    Operation(std::string name, bool builds, Benchmark run) : name(std::move(name)), builds(builds), run(std::move(run)) {}
+
+    std::string name;
+    bool builds = false;
+    Benchmark run;
+};
+
+/**
+ * @brief operations returns the benchmarks of all of the operations
+ * @return the benchmarks in the order of the operations in datastructures.hh
+ */
+std::vector<Operation> operations() {
+    std::vector<Operation> result;
+
+    result.emplace_back("add_station", true, build(no_setup, [](Datastructures& ds, NetworkData const& data) {
+        for (std::vector<std::tuple<StationID, Name, Coord>>::const_iterator it = data.stations.begin(); it != data.stations.end(); it++) {
+            ds.add_station(std::get<0>(*it), std::get<1>(*it), std::get<2>(*it));
+        }
+        return data.stations.size();
+    }));
+    result.emplace_back("add_stations", true, build(no_setup, [](Datastructures& ds, NetworkData const& data) {
+        ds.add_stations(data.stations);
+        return data.stations.size();
+    }));
+    result.emplace_back("station_count", station_query([](Fixture& f, std::size_t) {
+        benchmark::DoNotOptimize(f.ds->station_count());
+    }));
+    result.emplace_back("clear_all", true, build(add_network, [](Datastructures& ds, NetworkData const&) {
+        ds.clear_all();
+        return std::size_t(1);
+    }));
+    result.emplace_back("all_stations", station_query([](Fixture& f, std::size_t) {
+        benchmark::DoNotOptimize(f.ds->all_stations());
+    }));
+    result.emplace_back("get_station_name", station_query([](Fixture& f, std::size_t i) {
+        benchmark::DoNotOptimize(f.ds->get_station_name(station_id(f, i)));
+    }));
+    result.emplace_back("get_station_coordinates", station_query([](Fixture& f, std::size_t i) {
+        benchmark::DoNotOptimize(f.ds->get_station_coordinates(station_id(f, i)));
+    }));
+    result.emplace_back("stations_alphabetically", station_query([](Fixture& f, std::size_t) {
+        benchmark::DoNotOptimize(f.ds->stations_alphabetically());
+    }));
+    result.emplace_back("stations_distance_increasing", station_query([](Fixture& f, std::size_t) {
+        benchmark::DoNotOptimize(f.ds->stations_distance_increasing());
+    }));
+    result.emplace_back("find_station_with_coord", station_query([](Fixture& f, std::size_t i) {
+        benchmark::DoNotOptimize(f.ds->find_station_with_coord(std::get<2>(f.data.stations[i])));
+    }));
+    // Moves the station and back, so counts as two calls
+    result.emplace_back("change_station_coord", station_query([](Fixture& f, std::size_t i) {
+        Coord xy = std::get<2>(f.data.stations[i]);
+        f.ds->change_station_coord(station_id(f, i), Coord{xy.x + 1, xy.y});
+        f.ds->change_station_coord(station_id(f, i), xy);
+    }));
+    // Adds a departure and removes it, so counts as two calls
+    result.emplace_back("add_departure", station_query([](Fixture& f, std::size_t i) {
+        f.ds->add_departure(station_id(f, i), "extra", 1200);
+        f.ds->remove_departure(station_id(f, i), "extra", 1200);
+    }));
+    result.emplace_back("station_departures_after", station_query([](Fixture& f, std::size_t i) {
+        benchmark::DoNotOptimize(f.ds->station_departures_after(station_id(f, i), 1200));
+    }));
+    result.emplace_back("add_region", true, build(add_stations, [](Datastructures& ds, NetworkData const& data) {
+        for (std::vector<std::tuple<RegionID, Name, std::vector<Coord>>>::const_iterator it = data.regions.begin();
+             it != data.regions.end(); it++) {
+            ds.add_region(std::get<0>(*it), std::get<1>(*it), std::get<2>(*it));
+        }
+        return data.regions.size();
+    }));
+    result.emplace_back("all_regions", station_query([](Fixture& f, std::size_t) {
+        benchmark::DoNotOptimize(f.ds->all_regions());
+    }));
+    result.emplace_back("get_region_name", station_query([](Fixture& f, std::size_t i) {
+        benchmark::DoNotOptimize(f.ds->get_region_name(region_id(f, i)));
+    }));
+    result.emplace_back("get_region_coords", station_query([](Fixture& f, std::size_t i) {
+        benchmark::DoNotOptimize(f.ds->get_region_coords(region_id(f, i)));
+    }));
+    result.emplace_back("add_subregion_to_region", true, build(
+        [](Datastructures& ds, NetworkData const& data) {
+            add_stations(ds, data);
+            for (std::vector<std::tuple<RegionID, Name, std::vector<Coord>>>::const_iterator it = data.regions.begin();
+                 it != data.regions.end(); it++) {
+                ds.add_region(std::get<0>(*it), std::get<1>(*it), std::get<2>(*it));
+            }
+        },
+        [](Datastructures& ds, NetworkData const& data) {
+            for (std::vector<std::pair<RegionID, RegionID>>::const_iterator it = data.subregions.begin(); it != data.subregions.end(); it++) {
+                ds.add_subregion_to_region(it->first, it->second);
+            }
+            return data.subregions.size();
+        }));
+    result.emplace_back("add_station_to_region", true, build(
+        [](Datastructures& ds, NetworkData const& data) {
+            add_stations(ds, data);
+            for (std::vector<std::tuple<RegionID, Name, std::vector<Coord>>>::const_iterator it = data.regions.begin();
+                 it != data.regions.end(); it++) {
+                ds.add_region(std::get<0>(*it), std::get<1>(*it), std::get<2>(*it));
+            }
+        },
+        [](Datastructures& ds, NetworkData const& data) {
+            for (std::vector<std::pair<StationID, RegionID>>::const_iterator it = data.station_regions.begin();
+                 it != data.station_regions.end(); it++) {
+                ds.add_station_to_region(it->first, it->second);
+            }
+            return data.station_regions.size();
+        }));
+    result.emplace_back("station_in_regions", station_query([](Fixture& f, std::size_t i) {
+        benchmark::DoNotOptimize(f.ds->station_in_regions(station_id(f, i)));
+    }));
+    // The root region, whose subregions are all of the others
+    result.emplace_back("all_subregions_of_region", station_query([](Fixture& f, std::size_t) {
+        benchmark::DoNotOptimize(f.ds->all_subregions_of_region(1));
+    }));
+    result.emplace_back("count_subregions_of_region", station_query([](Fixture& f, std::size_t i) {
+        benchmark::DoNotOptimize(f.ds->count_subregions_of_region(region_id(f, i)));
+    }));
+    result.emplace_back("regions_containing", station_query([](Fixture& f, std::size_t i) {
+        benchmark::DoNotOptimize(f.ds->regions_containing(std::get<2>(f.data.stations[i])));
+    }));
+    result.emplace_back("stations_closest_to", station_query([](Fixture& f, std::size_t i) {
+        benchmark::DoNotOptimize(f.ds->stations_closest_to(std::get<2>(f.data.stations[i])));
+    }));
+    // Removes every tenth station of the network with their trains in each iteration
+    result.emplace_back("remove_station", true, build(add_network, [](Datastructures& ds, NetworkData const& data) {
+        std::size_t removed = 0;
+        for (std::size_t i = 0; i < data.stations.size(); i += 10) {
+            ds.remove_station(std::get<0>(data.stations[i]));
+            removed++;
+        }
+        return removed;
+    }));
+    result.emplace_back("common_parent_of_regions", pair_query([](Fixture& f, std::size_t i, std::size_t j, std::size_t) {
+        benchmark::DoNotOptimize(f.ds->common_parent_of_regions(region_id(f, i), region_id(f, j)));
+    }));
+    result.emplace_back("add_train", true, build(add_stations_and_regions, [](Datastructures& ds, NetworkData const& data) {
+        for (std::vector<std::pair<TrainID, Stops>>::const_iterator it = data.trains.begin(); it != data.trains.end(); it++) {
+            ds.add_train(it->first, it->second);
+        }
+        return data.trains.size();
+    }));
+    result.emplace_back("add_trains", true, build(add_stations_and_regions, [](Datastructures& ds, NetworkData const& data) {
+        ds.add_trains(data.trains);
+        return data.trains.size();
+    }));
+    result.emplace_back("next_stations_from", station_query([](Fixture& f, std::size_t i) {
+        benchmark::DoNotOptimize(f.ds->next_stations_from(station_id(f, i)));
+    }));
+    result.emplace_back("train_stations_from", station_query([](Fixture& f, std::size_t i) {
+        std::pair<TrainID, Stops> const& train = f.data.trains[i % f.data.trains.size()];
+        benchmark::DoNotOptimize(f.ds->train_stations_from(train.second.front().first, train.first));
+    }));
+    // Adds a copy of a train and removes it, so counts as two calls
+    result.emplace_back("remove_train", station_query([](Fixture& f, std::size_t i) {
+        f.ds->add_train("extra", f.data.trains[i % f.data.trains.size()].second);
+        f.ds->remove_train("extra");
+    }));
+    // Moves the times of a train later and back, so counts as two calls
+    result.emplace_back("update_train_times", station_query([](Fixture& f, std::size_t i) {
+        std::pair<TrainID, Stops> const& train = f.data.trains[i % f.data.trains.size()];
+        Stops later = train.second;
+        for (Stops::iterator it = later.begin(); it != later.end(); it++) {
+            it->second++;
+        }
+        f.ds->update_train_times(train.first, later);
+        f.ds->update_train_times(train.first, train.second);
+    }));
+    result.emplace_back("clear_trains", true, build(add_network, [](Datastructures& ds, NetworkData const&) {
+        ds.clear_trains();
+        return std::size_t(1);
+    }));
+    result.emplace_back("route_any", pair_query([](Fixture& f, std::size_t i, std::size_t j, std::size_t) {
+        benchmark::DoNotOptimize(f.ds->route_any(station_id(f, i), station_id(f, j)));
+    }));
+    for (SearchDirection direction : {SearchDirection::forward, SearchDirection::bidirectional}) {
+        std::string suffix = direction == SearchDirection::forward ? "" : "_bidirectional";
+        result.emplace_back("route_least_stations" + suffix,
+                            configured(direction, TimetableEngine::dijkstra,
+                                       pair_query([](Fixture& f, std::size_t i, std::size_t j, std::size_t) {
+                                           benchmark::DoNotOptimize(f.ds->route_least_stations(station_id(f, i), station_id(f, j)));
+                                       })));
+        result.emplace_back("route_shortest_distance" + suffix,
+                            configured(direction, TimetableEngine::dijkstra,
+                                       pair_query([](Fixture& f, std::size_t i, std::size_t j, std::size_t) {
+                                           benchmark::DoNotOptimize(f.ds->route_shortest_distance(station_id(f, i), station_id(f, j)));
+                                       })));
+    }
+    result.emplace_back("route_with_cycle", station_query([](Fixture& f, std::size_t i) {
+        benchmark::DoNotOptimize(f.ds->route_with_cycle(station_id(f, i)));
+    }));
+    // Eight origins to eight destinations
+    result.emplace_back("distance_matrix", pair_query([](Fixture& f, std::size_t i, std::size_t j, std::size_t) {
+        std::vector<StationID> origins;
+        std::vector<StationID> destinations;
+        for (std::size_t k = 0; k < 8; k++) {
+            origins.push_back(station_id(f, (i + k * 7919) % f.data.stations.size()));
+            destinations.push_back(station_id(f, (j + k * 7919) % f.data.stations.size()));
+        }
+        benchmark::DoNotOptimize(f.ds->distance_matrix(origins, destinations));
+    }));
+    // A batch of 64 queries of all of the kinds
+    result.emplace_back("route_queries", pair_query([](Fixture& f, std::size_t i, std::size_t j, std::size_t) {
+        std::vector<RouteQuery> queries;
+        for (std::size_t k = 0; k < 64; k++) {
+            RouteQuery query;
+            query.kind = (RouteQueryKind)(k % 3);
+            query.fromid = station_id(f, (i + k * 7919) % f.data.stations.size());
+            query.toid = station_id(f, (j + k * 7919) % f.data.stations.size());
+            query.starttime = 600;
+            queries.push_back(std::move(query));
+        }
+        benchmark::DoNotOptimize(f.ds->route_queries(queries));
+    }));
+    for (TimetableEngine engine : {TimetableEngine::dijkstra, TimetableEngine::connection_scan}) {
+        std::string suffix = engine == TimetableEngine::dijkstra ? "" : "_connection_scan";
+        result.emplace_back("route_earliest_arrival" + suffix,
+                            configured(SearchDirection::forward, engine,
+                                       pair_query([](Fixture& f, std::size_t i, std::size_t j, std::size_t) {
+                                           benchmark::DoNotOptimize(f.ds->route_earliest_arrival(station_id(f, i), station_id(f, j), 600));
+                                       })));
+    }
+    result.emplace_back("route_earliest_arrival_profile", pair_query([](Fixture& f, std::size_t i, std::size_t j, std::size_t) {
+        benchmark::DoNotOptimize(f.ds->route_earliest_arrival_profile(station_id(f, i), station_id(f, j), 600, 1200));
+    }));
+    result.emplace_back("route_earliest_arrival_transfers", pair_query([](Fixture& f, std::size_t i, std::size_t j, std::size_t) {
+        benchmark::DoNotOptimize(f.ds->route_earliest_arrival_transfers(station_id(f, i), station_id(f, j), 600));
+    }));
+    result.emplace_back("save_snapshot", station_query([](Fixture& f, std::size_t) {
+        f.ds->save_snapshot("benchmark.snapshot");
+    }));
+    // Loads the snapshot of the shared Datastructures to an empty one, which is created and destroyed without measuring
+    result.emplace_back("load_snapshot", [](benchmark::State& state, Network network, std::size_t n) {
+        fixture(network, n, true).ds->save_snapshot("benchmark.snapshot");
+        for (auto _ : state) {
+            state.PauseTiming();
+            std::unique_ptr<Datastructures> ds = std::make_unique<Datastructures>();
+            state.ResumeTiming();
+            ds->load_snapshot("benchmark.snapshot");
+            state.PauseTiming();
+            ds.reset();
+            state.ResumeTiming();
+        }
+    });
+    result.emplace_back("publish", true, build(add_network, [](Datastructures& ds, NetworkData const&) {
+        ds.publish();
+        return std::size_t(1);
+    }));
+    return result;
+}
+
+}  // namespace
+
+/**
+ * @brief main registers the benchmarks of every network for n = 10^3...max_stations and runs them
+ * @param argc the number of the arguments
+ * @param argv the arguments of Google Benchmark and --max_stations
+ * @return zero or one for unrecognized arguments
+ */
+int main(int argc, char** argv) {
+    std::vector<char*> args;
+    for (int i = 0; i < argc; i++) {
+        if (std::strncmp(argv[i], "--max_stations=", 15) == 0) {
+            max_stations = std::strtoull(argv[i] + 15, nullptr, 10);
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    int count = (int)args.size();
+    benchmark::Initialize(&count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(count, args.data())) {
+        return 1;
+    }
+
+    // The benchmarks are run in the order they are registered, so the ones building their own Datastructures
+    // are registered after the ones sharing one for each network
+    std::vector<Operation> all = operations();
+    for (Network network : {Network::grid, Network::scale_free, Network::timetable}) {
+        for (bool builds : {false, true}) {
+            for (std::vector<Operation>::const_iterator it = all.begin(); it != all.end(); it++) {
+                if (it->builds != builds) {
+                    continue;
+                }
+                Benchmark run = it->run;
+                benchmark::internal::Benchmark* registered = benchmark::RegisterBenchmark(
+                    (it->name + "/" + network_name(network)).c_str(), [run, network](benchmark::State& state) {
+                        run(state, network, (std::size_t)state.range(0));
+                        state.SetComplexityN(state.range(0));
+                    });
+                for (std::size_t n = 1000; n <= max_stations; n *= 10) {
+                    registered->Arg((std::int64_t)n);
+                }
+                registered->Complexity()->Unit(benchmark::kMicrosecond);
+            }
+        }
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    std::remove("benchmark.snapshot");
+    return 0;
+}
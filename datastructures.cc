@@ -1,8 +1,22 @@
 #include "datastructures.hh"
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <fstream>
 #include <random>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 std::minstd_rand rand_engine;  // Reasonably quick pseudo-random generator
 
 template <typename Type>
@@ -15,6 +29,221 @@ Type random_in_range(Type start, Type end) {
     return static_cast<Type>(start + num);
 }
 
+/**
+ * @brief squared_distances computes the squared distances from one point to an array of points given
+ *        as separate x and y arrays. The vector paths take the absolute differences in 64 bits and
+ *        multiply them as unsigned 32-bit values, so they give exactly the same results as squared_distance().
+ * @param origin Coord-struct of the point to measure from
+ * @param xs x-coordinates of the points
+ * @param ys y-coordinates of the points
+ * @param n the number of points
+ * @param out array of at least n values where the squared distances are written to
+ */
+void squared_distances(Coord origin, int const* xs, int const* ys, std::size_t n, long long* out) {
+    std::size_t i = 0;
+#if defined(__AVX2__)
+    __m256i const ox = _mm256_set1_epi64x(origin.x);
+    __m256i const oy = _mm256_set1_epi64x(origin.y);
+    __m256i const zero = _mm256_setzero_si256();
+    auto abs_diff = [&](__m256i value, __m256i o) {
+        __m256i d = _mm256_sub_epi64(value, o);
+        __m256i sign = _mm256_cmpgt_epi64(zero, d);
+        return _mm256_sub_epi64(_mm256_xor_si256(d, sign), sign);
+    };
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_cvtepi32_epi64(_mm_loadu_si128(reinterpret_cast<__m128i const*>(xs + i)));
+        __m256i y = _mm256_cvtepi32_epi64(_mm_loadu_si128(reinterpret_cast<__m128i const*>(ys + i)));
+        __m256i dx = abs_diff(x, ox);
+        __m256i dy = abs_diff(y, oy);
+        __m256i sum = _mm256_add_epi64(_mm256_mul_epu32(dx, dx), _mm256_mul_epu32(dy, dy));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), sum);
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    int64x2_t const ox = vdupq_n_s64(origin.x);
+    int64x2_t const oy = vdupq_n_s64(origin.y);
+    for (; i + 4 <= n; i += 4) {
+        int32x4_t x = vld1q_s32(xs + i);
+        int32x4_t y = vld1q_s32(ys + i);
+        uint32x2_t dx_low = vmovn_u64(vreinterpretq_u64_s64(vabsq_s64(vsubq_s64(vmovl_s32(vget_low_s32(x)), ox))));
+        uint32x2_t dx_high = vmovn_u64(vreinterpretq_u64_s64(vabsq_s64(vsubq_s64(vmovl_high_s32(x), ox))));
+        uint32x2_t dy_low = vmovn_u64(vreinterpretq_u64_s64(vabsq_s64(vsubq_s64(vmovl_s32(vget_low_s32(y)), oy))));
+        uint32x2_t dy_high = vmovn_u64(vreinterpretq_u64_s64(vabsq_s64(vsubq_s64(vmovl_high_s32(y), oy))));
+        uint64x2_t low = vmlal_u32(vmull_u32(dx_low, dx_low), dy_low, dy_low);
+        uint64x2_t high = vmlal_u32(vmull_u32(dx_high, dx_high), dy_high, dy_high);
+        vst1q_s64(out + i, vreinterpretq_s64_u64(low));
+        vst1q_s64(out + i + 2, vreinterpretq_s64_u64(high));
+    }
+#endif
+    for (; i < n; i++) {
+        out[i] = squared_distance(origin, {xs[i], ys[i]});
+    }
+}
+
+/**
+ * @brief WorkStealingPool::WorkStealingPool starts the threads of the pool, which wait for the first batch
+ * @param workers the number of workers including the thread calling run()
+ */
+WorkStealingPool::WorkStealingPool(std::size_t workers) {
+    for (std::size_t i = 0; i < std::max<std::size_t>(workers, 1); i++) {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+    threads_.reserve(queues_.size() - 1);
+    for (std::size_t i = 1; i < queues_.size(); i++) {
+        threads_.emplace_back(&WorkStealingPool::thread_main, this, i);
+    }
+}
+
+/**
+ * @brief WorkStealingPool::~WorkStealingPool stops and joins the threads of the pool
+ */
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    started_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+}
+
+/**
+ * @brief WorkStealingPool::run divides the tasks to the queues of the workers in contiguous blocks, wakes up
+ *        the threads and works as worker 0 until all of the tasks have been taken. Then waits for the other
+ *        workers to finish their last tasks. If the threads are running the batch of another thread, calls all
+ *        of the tasks on the calling thread as worker 0 instead of waiting for that batch.
+ * @param count the number of tasks
+ * @param task the function called with the worker and the index of each task
+ */
+void WorkStealingPool::run(std::size_t count, std::function<void(std::size_t, std::size_t)> const& task) {
+    std::unique_lock<std::mutex> batch_lock(run_mutex_, std::try_to_lock);
+    if (!batch_lock.owns_lock()) {
+        for (std::size_t i = 0; i < count; i++) {
+            task(0, i);
+        }
+        return;
+    }
+    std::size_t n = queues_.size();
+    for (std::size_t w = 0; w < n; w++) {
+        std::lock_guard<std::mutex> lock(queues_[w]->mutex);
+        for (std::size_t i = count * w / n; i < count * (w + 1) / n; i++) {
+            queues_[w]->tasks.push_back(i);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &task;
+        batch_++;
+        busy_ = threads_.size();
+    }
+    started_.notify_all();
+    work(0);
+    std::unique_lock<std::mutex> lock(mutex_);
+    finished_.wait(lock, [this]() { return busy_ == 0; });
+    task_ = nullptr;
+}
+
+/**
+ * @brief WorkStealingPool::take takes the next task of a worker from the back of its own queue or,
+ *        if it is empty, from the front of the first other queue that isn't
+ * @param worker the worker taking the task
+ * @param task the index of the task taken
+ * @return true if a task was taken, false if all of the queues are empty
+ */
+bool WorkStealingPool::take(std::size_t worker, std::size_t& task) {
+    {
+        std::lock_guard<std::mutex> lock(queues_[worker]->mutex);
+        if (!queues_[worker]->tasks.empty()) {
+            task = queues_[worker]->tasks.back();
+            queues_[worker]->tasks.pop_back();
+            return true;
+        }
+    }
+    for (std::size_t k = 1; k < queues_.size(); k++) {
+        Queue& victim = *queues_[(worker + k) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief WorkStealingPool::work runs the tasks of the current batch until there are none left to take
+ * @param worker the worker running the tasks
+ */
+void WorkStealingPool::work(std::size_t worker) {
+    std::size_t task;
+    while (take(worker, task)) {
+        (*task_)(worker, task);
+    }
+}
+
+/**
+ * @brief WorkStealingPool::thread_main is the loop of a thread of the pool, which waits for a new batch,
+ *        works on it and tells run() when it has finished
+ * @param worker the worker of the thread
+ */
+void WorkStealingPool::thread_main(std::size_t worker) {
+    std::size_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            started_.wait(lock, [this, seen]() { return stopping_ || batch_ != seen; });
+            if (stopping_) {
+                return;
+            }
+            seen = batch_;
+        }
+        work(worker);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--busy_ == 0) {
+            finished_.notify_one();
+        }
+    }
+}
+
+/**
+ * @brief SymbolTable::intern returns the symbol of the given string and adds the string to the table
+ *        first if it isn't there yet
+ * @param name the string
+ * @return the symbol of the string
+ */
+SymbolTable::Symbol SymbolTable::intern(std::string_view name) {
+    std::unordered_map<std::string_view, Symbol>::const_iterator it = symbols_.find(name);
+    if (it != symbols_.end()) {
+        return it->second;
+    }
+    Symbol symbol = names_.size();
+    names_.emplace_back(name);
+    symbols_.insert({names_.back(), symbol});
+    return symbol;
+}
+
+/**
+ * @brief SymbolTable::find returns the symbol of the given string
+ * @param name the string
+ * @return the symbol of the string or NO_SYMBOL if the string isn't in the table
+ */
+SymbolTable::Symbol SymbolTable::find(std::string_view name) const {
+    std::unordered_map<std::string_view, Symbol>::const_iterator it = symbols_.find(name);
+    if (it == symbols_.end()) {
+        return NO_SYMBOL;
+    }
+    return it->second;
+}
+
+/**
+ * @brief SymbolTable::clear removes all of the strings, which makes all of the symbols invalid
+ */
+void SymbolTable::clear() {
+    symbols_.clear();
+    names_.clear();
+}
+
 // Modify the code below to implement the functionality of the class.
 // Also remove comments from the parameter names when you implement
 // an operation (Commenting out parameter name prevents compiler from
@@ -24,6 +253,13 @@ Datastructures::Datastructures() {
 }
 
 Datastructures::~Datastructures() {
+    hierarchy_stopping = true;
+    if (hierarchy_builder.joinable()) {
+        hierarchy_builder.join();
+    }
+    for (std::atomic<SearchContext*>& slot : search_pool) {
+        delete slot.load();
+    }
 }
 
 /**
@@ -31,17 +267,47 @@ Datastructures::~Datastructures() {
  *        in the stations data structure
  * @return the size of the stations data structure
  */
-unsigned int Datastructures::station_count() {
+unsigned int Datastructures::station_count() const {
+    OperationTimer timer(*this, StatsOperation::station_count);
     return stations.size();
 }
 
 /**
  * @brief Datastructures::clear_all clears both of the regions and stations
- *        data structures leaving them with a size of 0
+ *        data structures leaving them with a size of 0. The trains can't stop at
+ *        the stations anymore, so they are cleared too.
  */
 void Datastructures::clear_all() {
-    stations.clear();
-    regions.clear();
+    OperationTimer timer(*this, StatsOperation::clear_all);
+    clear_data();
+}
+
+/**
+ * @brief Datastructures::clear_data clears the stations, regions and trains like clear_all, without counting a call
+ *        of clear_all. The maps are swapped empty before releasing the memory pools, since their buckets are in the
+ *        pools too.
+ */
+void Datastructures::clear_data() {
+    TrainMap(&train_memory).swap(trains);
+    train_memory.release();
+    StationMap(&station_memory).swap(stations);
+    RegionMap(&station_memory).swap(regions);
+    station_memory.release();
+    symbols.clear();
+    region_tree = RegionTree{};
+    region_tree_dirty = false;
+    stations_by_coord.clear();
+    station_grid.clear();
+    grid_min = NO_COORD;
+    grid_max = NO_COORD;
+    grid_rebuild_at = 64;
+    stations_by_name.clear();
+    stations_by_distance.clear();
+    stations_by_name_dirty = false;
+    stations_by_distance_dirty = false;
+    station_index.clear();
+    graph_dirty = true;
+    mutation_epoch++;
 }
 
 /**
@@ -49,12 +315,13 @@ void Datastructures::clear_all() {
  *        a vector and returns it
  * @return a vector, which includes all of the StationIDs of the stations
  */
-std::vector<StationID> Datastructures::all_stations() {
+std::vector<StationID> Datastructures::all_stations() const {
+    OperationTimer timer(*this, StatsOperation::all_stations);
     std::vector<StationID> all_stations;
     all_stations.reserve(stations.size());
 
-    for (std::unordered_map<StationID, Station>::iterator it = stations.begin(); it != stations.end(); it++) {
-        all_stations.push_back(it->second.id);
+    for (StationMap::const_iterator it = stations.begin(); it != stations.end(); it++) {
+        all_stations.push_back(symbols.name(it->second.id));
     }
     return all_stations;
 }
@@ -67,12 +334,67 @@ std::vector<StationID> Datastructures::all_stations() {
  * @return true if the station was added successfully, otherwise false
  */
 bool Datastructures::add_station(StationID id, const Name& name, Coord xy) {
-    std::unordered_map<StationID, Station>::const_iterator it = stations.find(id);
-    if (it == stations.end() && id != NO_STATION && name != NO_NAME && xy != NO_COORD) {
-        stations.insert({id, {id, name, xy, NO_REGION, {}, {}, 0, 999999, 999999, nullptr}});
-        return true;
+    OperationTimer timer(*this, StatsOperation::add_station);
+    return insert_station(std::move(id), Name(name), xy);
+}
+
+/**
+ * @brief Datastructures::add_station adds a station to the stations data structure if it doesnt't exist yet
+ *        and moves the given name to it
+ * @param id StationID of the station to be added
+ * @param name Name of the station to be added
+ * @param xy Coord-struct ie. location of the station to be added
+ * @return true if the station was added successfully, otherwise false
+ */
+bool Datastructures::add_station(StationID id, Name&& name, Coord xy) {
+    OperationTimer timer(*this, StatsOperation::add_station);
+    return insert_station(std::move(id), std::move(name), xy);
+}
+
+/**
+ * @brief Datastructures::add_stations adds many stations at once like add_station. Reserves space for all of
+ *        them first and adds them to the spatial index only in the end, rebuilding it at most once.
+ * @param batch a vector of the StationIDs, Names and Coord-structs of the stations to be added
+ * @return the number of stations added ie. the ones, which didn't already exist and had valid attributes
+ */
+unsigned int Datastructures::add_stations(std::vector<std::tuple<StationID, Name, Coord>> const& batch) {
+    OperationTimer timer(*this, StatsOperation::add_stations);
+    stations.reserve(stations.size() + batch.size());
+    station_index.reserve(station_index.size() + batch.size());
+    std::size_t first_added = station_index.size();
+    for (auto it = batch.begin(); it != batch.end(); it++) {
+        StationID const& id = std::get<0>(*it);
+        Name const& name = std::get<1>(*it);
+        Coord xy = std::get<2>(*it);
+        if (id == NO_STATION || name == NO_NAME || xy == NO_COORD) {
+            continue;
+        }
+        SymbolTable::Symbol symbol = symbols.intern(id);
+        std::pair<StationMap::iterator, bool> inserted = stations.try_emplace(symbol);
+        if (inserted.second) {
+            Station* station = &inserted.first->second;
+            station->id = symbol;
+            station->name = name;
+            station->location = xy;
+            station->index = station_index.size();
+            station_index.push_back(station);
+        }
     }
-    return false;
+    if (station_index.size() == first_added) {
+        return 0;
+    }
+    if (stations.size() >= grid_rebuild_at) {
+        rebuild_station_grid();
+    } else {
+        for (std::size_t i = first_added; i < station_index.size(); i++) {
+            index_station(station_index[i]);
+        }
+    }
+    stations_by_name_dirty = true;
+    stations_by_distance_dirty = true;
+    graph_dirty = true;
+    mutation_epoch++;
+    return station_index.size() - first_added;
 }
 
 /**
@@ -80,10 +402,11 @@ bool Datastructures::add_station(StationID id, const Name& name, Coord xy) {
  * @param id StationID of the station to be searched
  * @return the name of the station or NO_NAME if it wasn't found
  */
-Name Datastructures::get_station_name(StationID id) {
-    std::unordered_map<StationID, Station>::const_iterator it = stations.find(id);
+Name Datastructures::get_station_name(std::string_view id) const {
+    OperationTimer timer(*this, StatsOperation::get_station_name);
+    StationMap::const_iterator it = find_station(id);
     if (it != stations.end() && id != NO_STATION) {
-        return stations.at(id).name;
+        return it->second.name;
     }
     return NO_NAME;
 }
@@ -94,63 +417,59 @@ Name Datastructures::get_station_name(StationID id) {
  * @param id StationID of the station to be searched
  * @return the Coord-struct of the station ie. its location if it is found, otherwise NO_COORD
  */
-Coord Datastructures::get_station_coordinates(StationID id) {
-    std::unordered_map<StationID, Station>::const_iterator it = stations.find(id);
+Coord Datastructures::get_station_coordinates(std::string_view id) const {
+    OperationTimer timer(*this, StatsOperation::get_station_coordinates);
+    StationMap::const_iterator it = find_station(id);
     if (it != stations.end() && id != NO_STATION) {
-        return stations.at(id).location;
+        return it->second.location;
     }
     return NO_COORD;
 }
 
 /**
- * @brief Datastructures::stations_alphabetically adds all of the StationIDs of the stations
- *        to a vector based on the names of the stations
+ * @brief Datastructures::stations_alphabetically returns the StationIDs of all the stations
+ *        sorted by the names of the stations
  * @return a vector of StationIDs of the stations sorted by their names
  */
-std::vector<StationID> Datastructures::stations_alphabetically() {
-    std::vector<std::pair<StationID, Name>> v_of_stations;
-    std::vector<StationID> stations_by_name;
-
-    stations_by_name.reserve(stations.size());
-    v_of_stations.reserve(stations.size());
-
-    std::transform(stations.begin(), stations.end(), std::inserter(v_of_stations, v_of_stations.end()),
-                   [](std::pair<StationID, Station> const& p) { return std::pair<StationID, Name>(p.first, p.second.name); });
-
-    std::sort(v_of_stations.begin(), v_of_stations.end(),
-              [](std::pair<StationID, Name> a, std::pair<StationID, Name> b) { return a.second < b.second; });
-
-    std::transform(v_of_stations.begin(), v_of_stations.end(), std::inserter(stations_by_name, stations_by_name.end()),
-                   [](std::pair<StationID, Name> const& p) { return p.first; });
+std::vector<StationID> Datastructures::stations_alphabetically() const {
+    OperationTimer timer(*this, StatsOperation::stations_alphabetically);
+    return station_ids(sorted_by_name(), 0, stations.size());
+}
 
-    return stations_by_name;
+/**
+ * @brief Datastructures::stations_alphabetically returns a slice of the StationIDs of the stations
+ *        sorted by the names of the stations
+ * @param first the rank of the first station to return
+ * @param count the maximum number of stations to return
+ * @return a vector of at most count StationIDs starting from the given rank, empty if the rank
+ *         is past the last station
+ */
+std::vector<StationID> Datastructures::stations_alphabetically(unsigned int first, unsigned int count) const {
+    OperationTimer timer(*this, StatsOperation::stations_alphabetically);
+    return station_ids(sorted_by_name(), first, count);
 }
 
 /**
- * @brief Datastructures::stations_distance_increasing adds all of the StationIDs of the
- *        stations to a vector based on their location
+ * @brief Datastructures::stations_distance_increasing returns the StationIDs of all the stations
+ *        sorted by their distance from the coordinate (0, 0)
  * @return a vector of StationIDs based on the location of the stations
  */
-std::vector<StationID> Datastructures::stations_distance_increasing() {
-    std::vector<std::pair<StationID, Coord>> v_of_stations;
-    std::vector<StationID> stations_by_coord;
-
-    stations_by_coord.reserve(stations.size());
-    v_of_stations.reserve(stations.size());
-
-    std::transform(stations.begin(), stations.end(), std::inserter(v_of_stations, v_of_stations.end()),
-                   [](std::pair<StationID, Station> const& p) { return std::pair<StationID, Coord>(p.first, p.second.location); });
-
-    std::sort(v_of_stations.begin(), v_of_stations.end(), [](std::pair<StationID, Coord> a, std::pair<StationID, Coord> b) {if ( (sqrt(pow(a.second.x, 2) + pow(a.second.y, 2))) !=
-                     (sqrt(pow(b.second.x, 2) + pow(b.second.y, 2))))
-                      return (sqrt(pow(a.second.x, 2) + pow(a.second.y, 2))) <
-                             (sqrt(pow(b.second.x, 2) + pow(b.second.y, 2)));
-               else return a.second < b.second; });
-
-    std::transform(v_of_stations.begin(), v_of_stations.end(), std::inserter(stations_by_coord, stations_by_coord.end()),
-                   [](std::pair<StationID, Coord> const& p) { return p.first; });
+std::vector<StationID> Datastructures::stations_distance_increasing() const {
+    OperationTimer timer(*this, StatsOperation::stations_distance_increasing);
+    return station_ids(sorted_by_distance(), 0, stations.size());
+}
 
-    return stations_by_coord;
+/**
+ * @brief Datastructures::stations_distance_increasing returns a slice of the StationIDs of the stations
+ *        sorted by their distance from the coordinate (0, 0)
+ * @param first the rank of the first station to return
+ * @param count the maximum number of stations to return
+ * @return a vector of at most count StationIDs starting from the given rank, empty if the rank
+ *         is past the last station
+ */
+std::vector<StationID> Datastructures::stations_distance_increasing(unsigned int first, unsigned int count) const {
+    OperationTimer timer(*this, StatsOperation::stations_distance_increasing);
+    return station_ids(sorted_by_distance(), first, count);
 }
 
 /**
@@ -159,13 +478,13 @@ std::vector<StationID> Datastructures::stations_distance_increasing() {
  * @param xy the Coord-struct of the coordinates to be searched for
  * @return the StationID of the station if found, otherwise NO_STATION
  */
-StationID Datastructures::find_station_with_coord(Coord xy) {
-    for (std::unordered_map<StationID, Station>::const_iterator it = stations.begin(); it != stations.end(); it++) {
-        if (it->second.location == xy) {
-            return it->first;
-        }
+StationID Datastructures::find_station_with_coord(Coord xy) const {
+    OperationTimer timer(*this, StatsOperation::find_station_with_coord);
+    std::unordered_multimap<Coord, Station*, CoordHash>::const_iterator it = stations_by_coord.find(xy);
+    if (it == stations_by_coord.end()) {
+        return NO_STATION;
     }
-    return NO_STATION;
+    return symbols.name(it->second->id);
 }
 
 /**
@@ -175,10 +494,16 @@ StationID Datastructures::find_station_with_coord(Coord xy) {
  * @param newcoord the new Coord-struct to be assigned for the station if found
  * @return true if the station was found and its coordinates were changed, otherwise false
  */
-bool Datastructures::change_station_coord(StationID id, Coord newcoord) {
-    std::unordered_map<StationID, Station>::iterator it = stations.find(id);
+bool Datastructures::change_station_coord(std::string_view id, Coord newcoord) {
+    OperationTimer timer(*this, StatsOperation::change_station_coord);
+    StationMap::iterator it = find_station(id);
     if (it != stations.end()) {
+        unindex_station(&it->second);
         it->second.location = newcoord;
+        index_station(&it->second);
+        stations_by_distance_dirty = true;
+        graph_dirty = true;
+        mutation_epoch++;
         return true;
     }
     return false;
@@ -192,22 +517,15 @@ bool Datastructures::change_station_coord(StationID id, Coord newcoord) {
  * @param time Time of the departure
  * @return true if the departure didn't exist already and it was added succussfully, otherwise false
  */
-bool Datastructures::add_departure(StationID stationid, TrainID trainid, Time time) {
-    std::unordered_map<StationID, Station>::iterator it = stations.find(stationid);
+bool Datastructures::add_departure(std::string_view stationid, TrainID trainid, Time time) {
+    OperationTimer timer(*this, StatsOperation::add_departure);
+    StationMap::iterator it = find_station(stationid);
     if (it != stations.end()) {
-        std::unordered_map<Time, std::unordered_set<TrainID>>::iterator it2 = it->second.departures.find(time);
-
-        if (it2 != it->second.departures.end()) {
-            std::unordered_set<TrainID>::iterator it3 = it2->second.find(trainid);
-            if (it3 == it2->second.end()) {
-                it2->second.insert(trainid);
-                return true;
-            }
+        if (!insert_departure(it->second, symbols.intern(trainid), time)) {
             return false;
-        } else {
-            it->second.departures.insert({time, {trainid}});
-            return true;
         }
+        mutation_epoch++;
+        return true;
     }
     return false;
 }
@@ -220,55 +538,76 @@ bool Datastructures::add_departure(StationID stationid, TrainID trainid, Time ti
  * @param time Time of the departure
  * @return true if the departure did exist and it was removed successfully, otherwise false
  */
-bool Datastructures::remove_departure(StationID stationid, TrainID trainid, Time time) {
-    std::unordered_map<StationID, Station>::iterator it = stations.find(stationid);
-    if (it != stations.end()) {
-        std::unordered_map<Time, std::unordered_set<TrainID>>::iterator it2 = it->second.departures.find(time);
+bool Datastructures::remove_departure(std::string_view stationid, std::string_view trainid, Time time) {
+    OperationTimer timer(*this, StatsOperation::remove_departure);
+    StationMap::iterator it = find_station(stationid);
+    SymbolTable::Symbol train = symbols.find(trainid);
+    if (it != stations.end() && train != SymbolTable::NO_SYMBOL) {
+        Departures& departures = it->second.departures;
+        Departures::const_iterator it2 = find_departure(departures, time, train);
 
-        if (it2 == it->second.departures.end()) {
-            return false;
-        } else {
-            std::unordered_set<TrainID>::iterator it3 = it2->second.find(trainid);
-            if (it3 != it2->second.end()) {
-                it2->second.erase(it3);
-                if (it2->second.size() == 0) {
-                    it->second.departures.erase(time);
-                }
-                return true;
-            }
+        if (it2 == departures.end() || *it2 != std::make_pair(time, train)) {
             return false;
         }
+        departures.erase(it2);
+        mutation_epoch++;
+        return true;
     }
     return false;
 }
 
 /**
- * @brief Datastructures::station_departures_after searches all of the departures from the given station
- *        after a given time and adds those to a vector and sorts it based on the time and returns it
+ * @brief Datastructures::station_departures_after returns all of the departures from the given station
+ *        at or after a given time sorted by the time and the TrainIDs
  * @param stationid StatioID of the station
  * @param time the Time, whose after the departures will be addded
  * @return a vector of the found departures, {{NO_TIME, NO_TRAIN}} if the station wasn't found
  */
-std::vector<std::pair<Time, TrainID>> Datastructures::station_departures_after(StationID stationid, Time time) {
+std::vector<std::pair<Time, TrainID>> Datastructures::station_departures_after(std::string_view stationid, Time time) const {
+    return station_departures_after(stationid, time, std::numeric_limits<unsigned int>::max());
+}
+
+/**
+ * @brief Datastructures::station_departures_after returns the next departures from the given station
+ *        at or after a given time sorted by the time and the TrainIDs
+ * @param stationid StatioID of the station
+ * @param time the Time, whose after the departures will be addded
+ * @param limit the maximum number of departures to return
+ * @return a vector of at most limit found departures, {{NO_TIME, NO_TRAIN}} if the station wasn't found
+ */
+std::vector<std::pair<Time, TrainID>> Datastructures::station_departures_after(std::string_view stationid, Time time, unsigned int limit) const {
+    OperationTimer timer(*this, StatsOperation::station_departures_after);
+    std::string key;
     std::vector<std::pair<Time, TrainID>> result;
-    std::unordered_map<StationID, Station>::iterator it = stations.find(stationid);
+    if (departure_cache.enabled()) {
+        key = cache_key('d', stationid, {}, (std::uint64_t)time << 32 | limit);
+        if (departure_cache.find(key, mutation_epoch, result)) {
+            return result;
+        }
+    }
+    StationMap::const_iterator it = find_station(stationid);
 
     if (it == stations.end()) {
-        return {{NO_TIME, NO_TRAIN}};
-    } else {
-        for (std::unordered_map<Time, std::unordered_set<TrainID>>::iterator it2 = it->second.departures.begin();
-             it2 != it->second.departures.end(); it2++) {
-            if (it2->first >= time) {
-                for (std::unordered_set<TrainID>::const_iterator it3 = it2->second.begin(); it3 != it2->second.end(); it3++) {
-                    result.push_back({it2->first, *it3});
-                }
-            }
+        result = {{NO_TIME, NO_TRAIN}};
+        if (departure_cache.enabled()) {
+            departure_cache.insert(std::move(key), mutation_epoch, result);
         }
-        std::sort(result.begin(), result.end(), [](std::pair<Time, TrainID> a, std::pair<Time, TrainID> b) {if (a.first != b.first) return a.first < b.first;
-           else return a.second < b.second; });
-
         return result;
     }
+    Departures const& departures = it->second.departures;
+    Departures::const_iterator first =
+        std::lower_bound(departures.begin(), departures.end(), time,
+                         [](std::pair<Time, SymbolTable::Symbol> const& departure, Time t) { return departure.first < t; });
+    Departures::const_iterator last =
+        first + std::min<std::size_t>(limit, departures.end() - first);
+    result.reserve(last - first);
+    for (; first != last; first++) {
+        result.push_back(std::make_pair(first->first, symbols.name(first->second)));
+    }
+    if (departure_cache.enabled()) {
+        departure_cache.insert(std::move(key), mutation_epoch, result);
+    }
+    return result;
 }
 
 /**
@@ -280,23 +619,33 @@ std::vector<std::pair<Time, TrainID>> Datastructures::station_departures_after(S
  * @return true if the region didn't already exist and it was added successfully, otherwise false
  */
 bool Datastructures::add_region(RegionID id, Name const& name, std::vector<Coord> coords) {
-    std::unordered_map<RegionID, Region>::const_iterator it = regions.find(id);
-    if (it == regions.end()) {
-        regions.insert({id, {id, name, coords, NO_REGION, {}}});
-        return true;
-    }
-    return false;
+    OperationTimer timer(*this, StatsOperation::add_region);
+    return insert_region(id, Name(name), std::move(coords));
+}
+
+/**
+ * @brief Datastructures::add_region adds a new regions with the given attributes to the regions data
+ *        structure if it doesn't already exist and moves the given name to it
+ * @param id RegionID of the region to be added
+ * @param name Name of the region to be added
+ * @param coords vector of the coordinates ie. Coord-structs of the region
+ * @return true if the region didn't already exist and it was added successfully, otherwise false
+ */
+bool Datastructures::add_region(RegionID id, Name&& name, std::vector<Coord> coords) {
+    OperationTimer timer(*this, StatsOperation::add_region);
+    return insert_region(id, std::move(name), std::move(coords));
 }
 
 /**
  * @brief Datastructures::all_regions adds RegionIDs of all the regions to a vector and returns it
  * @return a vector of RegionIDs of all the regions
  */
-std::vector<RegionID> Datastructures::all_regions() {
+std::vector<RegionID> Datastructures::all_regions() const {
+    OperationTimer timer(*this, StatsOperation::all_regions);
     std::vector<RegionID> all_regions;
     all_regions.reserve(regions.size());
 
-    for (std::unordered_map<RegionID, Region>::const_iterator it = regions.begin(); it != regions.end(); it++) {
+    for (RegionMap::const_iterator it = regions.begin(); it != regions.end(); it++) {
         all_regions.push_back(it->first);
     }
     return all_regions;
@@ -307,12 +656,13 @@ std::vector<RegionID> Datastructures::all_regions() {
  * @param id RegionID of the region to be searched
  * @return the Name of the region if it was found, otherwise NO_NAME
  */
-Name Datastructures::get_region_name(RegionID id) {
-    std::unordered_map<RegionID, Region>::const_iterator it = regions.find(id);
+Name Datastructures::get_region_name(RegionID id) const {
+    OperationTimer timer(*this, StatsOperation::get_region_name);
+    RegionMap::const_iterator it = regions.find(id);
     if (it == regions.end()) {
         return NO_NAME;
     }
-    return regions.at(id).name;
+    return it->second.name;
 }
 
 /**
@@ -321,12 +671,13 @@ Name Datastructures::get_region_name(RegionID id) {
  * @param id RegionID of the region to be searched
  * @return a vector of the regions coordinates it it was found, otherwise a vector {NO_COORD}
  */
-std::vector<Coord> Datastructures::get_region_coords(RegionID id) {
-    std::unordered_map<RegionID, Region>::const_iterator it = regions.find(id);
+std::vector<Coord> Datastructures::get_region_coords(RegionID id) const {
+    OperationTimer timer(*this, StatsOperation::get_region_coords);
+    RegionMap::const_iterator it = regions.find(id);
     if (it == regions.end()) {
         return {NO_COORD};
     }
-    return regions.at(id).coordinates;
+    return it->second.coordinates;
 }
 
 /**
@@ -338,16 +689,18 @@ std::vector<Coord> Datastructures::get_region_coords(RegionID id) {
  *         another region, otherwise false
  */
 bool Datastructures::add_subregion_to_region(RegionID id, RegionID parentid) {
-    std::unordered_map<RegionID, Region>::iterator it = regions.find(id);
-    std::unordered_map<RegionID, Region>::iterator it2 = regions.find(parentid);
+    OperationTimer timer(*this, StatsOperation::add_subregion_to_region);
+    RegionMap::iterator it = regions.find(id);
+    RegionMap::iterator it2 = regions.find(parentid);
     if (it == regions.end() || it2 == regions.end() || it->second.parent != NO_REGION) {
         return false;
     } else {
-        std::unordered_set<RegionID>::const_iterator it3 = it2->second.subregions.find(id);
+        std::pmr::unordered_set<RegionID>::const_iterator it3 = it2->second.subregions.find(id);
         if (it3 == it2->second.subregions.end()) {
             it2->second.subregions.insert(id);
         }
         it->second.parent = it2->first;
+        region_tree_dirty = true;
         return true;
     }
 }
@@ -359,9 +712,10 @@ bool Datastructures::add_subregion_to_region(RegionID id, RegionID parentid) {
  * @return true if the station and region could be found and
  *         the station was added successfully to a region, otherwise false
  */
-bool Datastructures::add_station_to_region(StationID id, RegionID parentid) {
-    std::unordered_map<StationID, Station>::iterator it = stations.find(id);
-    std::unordered_map<RegionID, Region>::iterator it2 = regions.find(parentid);
+bool Datastructures::add_station_to_region(std::string_view id, RegionID parentid) {
+    OperationTimer timer(*this, StatsOperation::add_station_to_region);
+    StationMap::iterator it = find_station(id);
+    RegionMap::iterator it2 = regions.find(parentid);
     if (it == stations.end() || it2 == regions.end() || it->second.region != NO_REGION) {
         return false;
     }
@@ -376,23 +730,22 @@ bool Datastructures::add_station_to_region(StationID id, RegionID parentid) {
  * @return the vector of all of the regions the station is part of, {NO_REGION} if the station
  *         couldn't be found and {} if the station isn't part of any region
  */
-std::vector<RegionID> Datastructures::station_in_regions(StationID id) {
-    std::vector<RegionID> result;
-    std::unordered_map<StationID, Station>::const_iterator it = stations.find(id);
+std::vector<RegionID> Datastructures::station_in_regions(std::string_view id) const {
+    OperationTimer timer(*this, StatsOperation::station_in_regions);
+    StationMap::const_iterator it = find_station(id);
 
     if (it == stations.end()) {
         return {NO_REGION};
     } else if (it->second.region == NO_REGION) {
         return {};
     } else {
-        std::unordered_map<RegionID, Region>::iterator help_it = regions.find(it->second.region);
-        while (true) {
-            if (help_it != regions.end()) {
-                result.push_back(help_it->second.id);
-                help_it = regions.find(help_it->second.parent);
-            } else {
-                break;
-            }
+        RegionTree const& tree = current_region_tree();
+        std::uint32_t i = regions.at(it->second.region).index;
+        std::vector<RegionID> result;
+        // Regions in a cycle of parents have no depth, so they are listed until the cycle repeats
+        result.reserve(tree.root[i] == NO_INDEX ? tree.regions.size() : tree.depth[i] + 1);
+        for (; i != NO_INDEX && result.size() < tree.regions.size(); i = tree.parent[i]) {
+            result.push_back(tree.regions[i]->id);
         }
         return result;
     }
@@ -405,18 +758,74 @@ std::vector<RegionID> Datastructures::station_in_regions(StationID id) {
  * @return a vector of all the subregions, {NO_REGION} if the region wasn't found
  *         and {} if the region has no subregions
  */
-std::vector<RegionID> Datastructures::all_subregions_of_region(RegionID id) {
-    std::vector<RegionID> result;
-    std::unordered_map<RegionID, Region>::iterator it = regions.find(id);
+std::vector<RegionID> Datastructures::all_subregions_of_region(RegionID id) const {
+    OperationTimer timer(*this, StatsOperation::all_subregions_of_region);
+    RegionMap::const_iterator it = regions.find(id);
 
     if (it == regions.end()) {
         return {NO_REGION};
     } else if (it->second.subregions.size() == 0) {
         return {};
-    } else {
-        regions_recursively(result, it);
-        return result;
     }
+    RegionTree const& tree = current_region_tree();
+    std::uint32_t i = it->second.index;
+    if (tree.root[i] == NO_INDEX) {
+        return subregions_in_cycle(tree, i);
+    }
+    return std::vector<RegionID>(tree.preorder.begin() + tree.tin[i] + 1, tree.preorder.begin() + tree.tout[i]);
+}
+
+/**
+ * @brief Datastructures::count_subregions_of_region returns the number of the regions that are directly or
+ *        indirectly subregions of the given region
+ * @param id RegionID of the region
+ * @return the number of the subregions or NO_VALUE if the region wasn't found
+ */
+int Datastructures::count_subregions_of_region(RegionID id) const {
+    OperationTimer timer(*this, StatsOperation::count_subregions_of_region);
+    RegionMap::const_iterator it = regions.find(id);
+
+    if (it == regions.end()) {
+        return NO_VALUE;
+    }
+    RegionTree const& tree = current_region_tree();
+    std::uint32_t i = it->second.index;
+    if (tree.root[i] == NO_INDEX) {
+        return subregions_in_cycle(tree, i).size();
+    }
+    return tree.tout[i] - tree.tin[i] - 1;
+}
+
+/**
+ * @brief Datastructures::regions_containing returns all of the regions, whose polygon contains the given point.
+ *        Goes through the region trees in pre-order and skips the subtrees, whose bounding box doesn't contain
+ *        the point. The polygons of the other regions are checked first with their own bounding box.
+ * @param xy Coord-struct of the point
+ * @return a vector of RegionIDs of the regions containing the point, every region before its subregions,
+ *         and {} if there are none
+ */
+std::vector<RegionID> Datastructures::regions_containing(Coord xy) const {
+    OperationTimer timer(*this, StatsOperation::regions_containing);
+    RegionTree const& tree = current_region_tree();
+    std::vector<RegionID> result;
+    auto check = [this, &tree, &result, xy](std::uint32_t i) {
+        if (tree.boxes[i].contains(xy) && polygon_contains(tree.regions[i]->coordinates, xy)) {
+            result.push_back(tree.regions[i]->id);
+        }
+    };
+    for (std::uint32_t p = 0; p < tree.preorder.size();) {
+        std::uint32_t i = tree.preorder_index[p];
+        if (!tree.subtree_boxes[p].contains(xy)) {
+            p = tree.tout[i];
+            continue;
+        }
+        check(i);
+        p++;
+    }
+    for (std::uint32_t i : tree.unrooted) {
+        check(i);
+    }
+    return result;
 }
 
 /**
@@ -427,55 +836,161 @@ std::vector<RegionID> Datastructures::all_subregions_of_region(RegionID id) {
  *         closest to the given coordinate or a vector of less than three stations
  *         if there wasn't that many
  */
-std::vector<StationID> Datastructures::stations_closest_to(Coord xy) {
+std::vector<StationID> Datastructures::stations_closest_to(Coord xy) const {
+    return stations_closest_to(xy, 3);
+}
+
+/**
+ * @brief Datastructures::stations_closest_to returns k of the closest stations to the given
+ *        coordinate or less if there aren't k stations to return. Searches the grid cells of the
+ *        spatial index in growing rings around the coordinate until the next ring is further away
+ *        than the k:th closest station found so far.
+ * @param xy the Coord-struct ie. coordinates where to find the closest stations
+ * @param k the number of stations to return
+ * @return a vector of StationIDs of the k closest stations sorted by their distance to the given
+ *         coordinate, then by their coordinates, or a vector of less than k stations if there wasn't that many
+ */
+std::vector<StationID> Datastructures::stations_closest_to(Coord xy, unsigned int k) const {
+    OperationTimer timer(*this, StatsOperation::stations_closest_to);
     std::vector<StationID> stations_closest;
+    if (k == 0 || stations.empty()) {
+        return stations_closest;
+    }
+    using Candidate = std::tuple<long long, Coord, StationID const*>;
+    auto closer = [](Candidate const& a, Candidate const& b) {
+        if (std::get<0>(a) != std::get<0>(b)) return std::get<0>(a) < std::get<0>(b);
+        if (std::get<1>(a) != std::get<1>(b)) return std::get<1>(a) < std::get<1>(b);
+        return *std::get<2>(a) < *std::get<2>(b);
+    };
+    // Max-heap of the best candidates, the worst one of them on top
+    std::priority_queue<Candidate, std::vector<Candidate>, decltype(closer)> best(closer);
+
+    Coord cell = grid_cell(xy);
+    long long first_ring = std::max({0LL, (long long)grid_min.x - cell.x, (long long)cell.x - grid_max.x,
+                                     (long long)grid_min.y - cell.y, (long long)cell.y - grid_max.y});
+    long long last_ring = std::max({std::abs((long long)cell.x - grid_min.x), std::abs((long long)cell.x - grid_max.x),
+                                    std::abs((long long)cell.y - grid_min.y), std::abs((long long)cell.y - grid_max.y)});
 
-    std::pair<StationID, Coord> firstmin = std::make_pair(StationID("1"), Coord{999999, 999999});
-    std::pair<StationID, Coord> secmin = std::make_pair(StationID("2"), Coord{999999, 999999});
-    std::pair<StationID, Coord> thirdmin = std::make_pair(StationID("3"), Coord{999999, 999999});
+    // Squared distances to the stations of the cell visited, reused between the cells
+    std::vector<long long> distances;
+    auto visit = [&](long long cx, long long cy) {
+        std::unordered_map<Coord, GridCell, CoordHash>::const_iterator it = station_grid.find(Coord{(int)cx, (int)cy});
+        if (it == station_grid.end()) {
+            return;
+        }
+        GridCell const& in_cell = it->second;
+        distances.resize(in_cell.stations.size());
+        squared_distances(xy, in_cell.xs.data(), in_cell.ys.data(), in_cell.stations.size(), distances.data());
+        for (std::size_t i = 0; i < in_cell.stations.size(); i++) {
+            if (best.size() == k && distances[i] > std::get<0>(best.top())) {
+                continue;
+            }
+            Station const* station = in_cell.stations[i];
+            Candidate candidate{distances[i], station->location, &symbols.name(station->id)};
+            if (best.size() < k) {
+                best.push(candidate);
+            } else if (closer(candidate, best.top())) {
+                best.pop();
+                best.push(candidate);
+            }
+        }
+    };
 
-    for (std::unordered_map<StationID, Station>::iterator it = stations.begin(); it != stations.end(); it++) {
-        if (distance_between_points(it->second.location, xy) < distance_between_points(firstmin.second, xy)) {
-            thirdmin = secmin;
-            secmin = firstmin;
-            firstmin = std::make_pair(it->first, it->second.location);
-        } else if (distance_between_points(it->second.location, xy) < distance_between_points(secmin.second, xy)) {
-            thirdmin = secmin;
-            secmin = std::make_pair(it->first, it->second.location);
-        } else if (distance_between_points(it->second.location, xy) < distance_between_points(thirdmin.second, xy)) {
-            thirdmin = std::make_pair(it->first, it->second.location);
+    for (long long r = first_ring; r <= last_ring; r++) {
+        // Every station in ring r is at least (r - 1) cells away from the coordinate
+        if (best.size() == k && r > 1) {
+            long long bound = (r - 1) * grid_cell_size;
+            if (bound * bound > std::get<0>(best.top())) {
+                break;
+            }
+        }
+        long long low_y = std::max(cell.y - r, (long long)grid_min.y);
+        long long high_y = std::min(cell.y + r, (long long)grid_max.y);
+        for (long long cy = low_y; cy <= high_y; cy++) {
+            if (cy == cell.y - r || cy == cell.y + r) {
+                long long low_x = std::max(cell.x - r, (long long)grid_min.x);
+                long long high_x = std::min(cell.x + r, (long long)grid_max.x);
+                for (long long cx = low_x; cx <= high_x; cx++) {
+                    visit(cx, cy);
+                }
+            } else {
+                if (cell.x - r >= grid_min.x) {
+                    visit(cell.x - r, cy);
+                }
+                if (r != 0 && cell.x + r <= grid_max.x) {
+                    visit(cell.x + r, cy);
+                }
+            }
         }
     }
-    if (stations.empty()) {
-        return stations_closest;
-    } else if (stations.size() == 1) {
-        stations_closest.push_back(firstmin.first);
-        return stations_closest;
-    } else if (stations.size() == 2) {
-        stations_closest.push_back(firstmin.first);
-        stations_closest.push_back(secmin.first);
-        return stations_closest;
-    } else {
-        stations_closest.push_back(firstmin.first);
-        stations_closest.push_back(secmin.first);
-        stations_closest.push_back(thirdmin.first);
-        return stations_closest;
+
+    stations_closest.resize(best.size());
+    for (auto it = stations_closest.rbegin(); it != stations_closest.rend(); it++) {
+        *it = *std::get<2>(best.top());
+        best.pop();
     }
+    return stations_closest;
 }
 
 /**
  * @brief Datastructures::remove_station removes a station with the given id from the
- *        stations data structure if it was found
+ *        stations data structure if it was found. The trains stopping at the station skip it from then on: the
+ *        station is dropped from their stops, so no other station refers to it anymore. Only the trains found
+ *        from the train stops of the station are touched. A train, whose last stop was the station, doesn't
+ *        depart anymore from its new last stop.
  * @param id StationID of the station to be removed
  * @return true if the station was found and removed successfully, otherwise false
  */
-bool Datastructures::remove_station(StationID id) {
-    std::unordered_map<StationID, Station>::const_iterator it = stations.find(id);
+bool Datastructures::remove_station(std::string_view id) {
+    OperationTimer timer(*this, StatsOperation::remove_station);
+    StationMap::iterator it = find_station(id);
 
     if (it == stations.end()) {
         return false;
     }
+    Station* station = &it->second;
+    std::vector<Train*> stopping;
+    stopping.reserve(station->train_stops.size());
+    for (std::pair<Train const* const, std::size_t> const& stop : station->train_stops) {
+        stopping.push_back(&trains.find(stop.first->id)->second);
+    }
+    for (Train* train : stopping) {
+        unlink_train(*train);
+        bool ended_here = train->stops.back() == station;
+        std::size_t kept = 0;
+        for (std::size_t k = 0; k < train->stops.size(); k++) {
+            if (train->stops[k] != station) {
+                train->stops[kept] = train->stops[k];
+                train->times[kept] = train->times[k];
+                kept++;
+            }
+        }
+        train->stops.resize(kept);
+        train->times.resize(kept);
+        if (ended_here && kept > 0) {
+            Station* last = train->stops.back();
+            std::pair<Time, SymbolTable::Symbol> departure(train->times.back(), train->id);
+            bool departs_again = false;
+            for (std::size_t k = 0; k + 1 < kept; k++) {
+                departs_again = departs_again || (train->stops[k] == last && train->times[k] == departure.first);
+            }
+            Departures::const_iterator found = find_departure(last->departures, departure.first, departure.second);
+            if (!departs_again && found != last->departures.end() && *found == departure) {
+                last->departures.erase(found);
+            }
+        }
+        link_train(*train);
+    }
+    unindex_station(&it->second);
+    std::uint32_t index = it->second.index;
+    station_index[index] = station_index.back();
+    station_index[index]->index = index;
+    station_index.pop_back();
+    graph_dirty = true;
+    mutation_epoch++;
     stations.erase(it);
+    stations_by_name_dirty = true;
+    stations_by_distance_dirty = true;
     return true;
 }
 
@@ -487,47 +1002,47 @@ bool Datastructures::remove_station(StationID id) {
  * @return RegionID of the closest parent region or NO_REGION if either of the given regions
  *         could be found in the datastructure or a common parent region can't be found
  */
-RegionID Datastructures::common_parent_of_regions(RegionID id1, RegionID id2) {
-    std::unordered_map<RegionID, Region>::const_iterator it1 = regions.find(id1);
-    std::unordered_map<RegionID, Region>::const_iterator it2 = regions.find(id2);
-
-    std::list<RegionID> parents_of_id1;
-    std::list<RegionID> parents_of_id2;
+RegionID Datastructures::common_parent_of_regions(RegionID id1, RegionID id2) const {
+    OperationTimer timer(*this, StatsOperation::common_parent_of_regions);
+    RegionMap::const_iterator it1 = regions.find(id1);
+    RegionMap::const_iterator it2 = regions.find(id2);
 
     if (it1 == regions.end() || it2 == regions.end()) {
         return NO_REGION;
-    } else {
-        if (it1->second.parent == it2->second.parent) {
-            return it1->second.parent;
-        } else {
-            while (true) {
-                if (it1->second.parent != NO_REGION && it1 != regions.end()) {
-                    parents_of_id1.push_back(it1->second.parent);
-                    it1 = regions.find(it1->second.parent);
-                }
-                if (it2->second.parent != NO_REGION && it2 != regions.end()) {
-                    parents_of_id2.push_back(it2->second.parent);
-                    it2 = regions.find(it2->second.parent);
-                }
-                if ((it1 == regions.end() || it1->second.parent == NO_REGION) && (it2 == regions.end() || it2->second.parent == NO_REGION)) {
-                    break;
-                }
-            }
-            if (parents_of_id1.empty() || parents_of_id2.empty()) {
-                return NO_REGION;
-            }
-            auto it = std::find_first_of(parents_of_id1.begin(), parents_of_id1.end(), parents_of_id2.begin(), parents_of_id2.end());
-            if (it != parents_of_id1.end()) {
-                return *it;
-            }
-            return NO_REGION;
-        }
     }
+    if (it1->second.parent == it2->second.parent) {
+        return it1->second.parent;
+    }
+    RegionTree const& tree = current_region_tree();
+    std::uint32_t u = it1->second.index;
+    std::uint32_t v = it2->second.index;
+    if (tree.root[u] == NO_INDEX || tree.root[u] != tree.root[v]) {
+        return NO_REGION;
+    }
+    std::uint32_t l = tree.first[u];
+    std::uint32_t r = tree.first[v];
+    if (l > r) {
+        std::swap(l, r);
+    }
+    std::uint32_t j = 0;
+    while ((2u << j) <= r - l + 1) {
+        j++;
+    }
+    std::uint32_t a = tree.sparse[j][l];
+    std::uint32_t b = tree.sparse[j][r + 1 - (1u << j)];
+    std::uint32_t lca = tree.depth[a] <= tree.depth[b] ? a : b;
+    // The common parent has to be a parent of both, so if one region is under the other one the
+    // parent of the upper one is returned
+    if (lca == u || lca == v) {
+        lca = tree.parent[lca];
+    }
+    return lca == NO_INDEX ? NO_REGION : tree.regions[lca]->id;
 }
 
 /**
  * @brief Datastructures::add_train adds a new train with the given attributes to the trains data
- *        structure if it doesn't already exist
+ *        structure if it doesn't already exist. Also adds the departures of the train and updates
+ *        the trains and the next stations of the stations it stops at.
  * @param trainid TrainID of the train to be added
  * @param stationtimes a vector of pairs of the stations the train goes through and departure times
  *        from those stations
@@ -535,54 +1050,110 @@ RegionID Datastructures::common_parent_of_regions(RegionID id1, RegionID id2) {
  *         station existed, otherwise false
  */
 bool Datastructures::add_train(TrainID trainid, std::vector<std::pair<StationID, Time>> stationtimes) {
-    std::unordered_map<TrainID, Train>::iterator it = trains.find(trainid);
-    if (it != trains.end()) {
+    OperationTimer timer(*this, StatsOperation::add_train);
+    std::vector<Station*> stops;
+    if (!find_stops(stationtimes, stops)) {
         return false;
-    } else {
-        for (auto it = stationtimes.begin(); it != stationtimes.end(); it++) {
-            std::unordered_map<StationID, Station>::iterator it2 = stations.find(it->first);
-            if (it2 == stations.end()) {
-                return false;
-            }
+    }
+    SymbolTable::Symbol id = symbols.intern(trainid);
+    std::pair<TrainMap::iterator, bool> inserted = trains.try_emplace(id);
+    if (!inserted.second) {
+        return false;
+    }
+    Train& train = inserted.first->second;
+    train.id = id;
+    train.stops.assign(stops.begin(), stops.end());
+    train.times.reserve(stationtimes.size());
+    for (std::size_t k = 0; k < stationtimes.size(); k++) {
+        train.times.push_back(stationtimes[k].second);
+        if (k + 1 < stationtimes.size()) {
+            insert_departure(*train.stops[k], id, stationtimes[k].second);
         }
-        trains.insert({trainid, {trainid, stationtimes}});
-        for (auto it = stationtimes.begin(); it != stationtimes.end(); it++) {
-            if (it < stationtimes.end() - 1) {
-                add_departure(it->first, trainid, it->second);
-                auto it_next = it + 1;
-                Station* p = &stations.at(it_next->first);
-                std::pair<Time, std::pair<Time, Station*>> pair = std::make_pair(it->second, std::make_pair(it_next->second, p));
-                stations.at(it->first).stations_to.push_back(pair);
-            }
+    }
+    link_train(train);
+    graph_dirty = true;
+    mutation_epoch++;
+    return true;
+}
+
+/**
+ * @brief Datastructures::add_trains adds many trains at once like add_train. Looks up the stops of every train
+ *        once, reserves the departures of the stations and appends them unsorted, so every station touched is
+ *        sorted only once in the end.
+ * @param batch a vector of the TrainIDs and the stationtimes of the trains to be added
+ * @return the number of trains added ie. the ones, which didn't already exist and whose stations existed
+ */
+unsigned int Datastructures::add_trains(std::vector<std::pair<TrainID, std::vector<std::pair<StationID, Time>>>> const& batch) {
+    OperationTimer timer(*this, StatsOperation::add_trains);
+    trains.reserve(trains.size() + batch.size());
+    std::vector<Train const*> added;
+    added.reserve(batch.size());
+    std::vector<std::uint32_t> new_departures(station_index.size(), 0);
+    std::vector<Station*> stops;
+    for (auto it = batch.begin(); it != batch.end(); it++) {
+        if (find_train(it->first) != trains.end() || !find_stops(it->second, stops)) {
+            continue;
         }
-        return true;
+        SymbolTable::Symbol id = symbols.intern(it->first);
+        std::pair<TrainMap::iterator, bool> inserted = trains.try_emplace(id);
+        if (!inserted.second) {
+            continue;
+        }
+        Train& train = inserted.first->second;
+        train.id = id;
+        train.stops.assign(stops.begin(), stops.end());
+        train.times.reserve(it->second.size());
+        for (std::pair<StationID, Time> const& stop : it->second) {
+            train.times.push_back(stop.second);
+        }
+        added.push_back(&train);
+        for (std::size_t k = 0; k + 1 < stops.size(); k++) {
+            new_departures[stops[k]->index]++;
+        }
+    }
+    std::vector<Station*> touched;
+    for (std::uint32_t i = 0; i < new_departures.size(); i++) {
+        if (new_departures[i] > 0) {
+            station_index[i]->departures.reserve(station_index[i]->departures.size() + new_departures[i]);
+            touched.push_back(station_index[i]);
+        }
+    }
+    for (Train const* train : added) {
+        for (std::size_t k = 0; k + 1 < train->stops.size(); k++) {
+            train->stops[k]->departures.push_back({train->times[k], train->id});
+        }
+        link_train(*train);
+    }
+    for (Station* station : touched) {
+        Departures& departures = station->departures;
+        std::sort(departures.begin(), departures.end(),
+                  [this](std::pair<Time, SymbolTable::Symbol> a, std::pair<Time, SymbolTable::Symbol> b) { return departure_less(a, b); });
+        departures.erase(std::unique(departures.begin(), departures.end()), departures.end());
     }
+    if (!added.empty()) {
+        graph_dirty = true;
+        mutation_epoch++;
+    }
+    return added.size();
 }
 
 /**
  * @brief Datastructures::next_stations_from returns stations that are next stations from the given one
  * @param id StationID of the station to get next stations from
- * @return a vector of StationIDs of the stations, empty vector if there are no departures from the station and
- *         {NO_STATION} if the station wasn't found
+ * @return a vector of StationIDs of the stations, each of them once, empty vector if there are no trains
+ *         leaving from the station and {NO_STATION} if the station wasn't found
  */
-std::vector<StationID> Datastructures::next_stations_from(StationID id) {
-    std::unordered_map<StationID, Station>::iterator it = stations.find(id);
+std::vector<StationID> Datastructures::next_stations_from(std::string_view id) const {
+    OperationTimer timer(*this, StatsOperation::next_stations_from);
+    StationMap::const_iterator it = find_station(id);
 
     if (it == stations.end()) {
         return {NO_STATION};
     }
-    if (it->second.departures.size() == 0) {
-        return {};
-    }
     std::vector<StationID> result;
-    for (std::unordered_map<TrainID, Train>::iterator it2 = trains.begin(); it2 != trains.end(); it2++) {
-        for (std::vector<std::pair<StationID, Time>>::iterator it3 = it2->second.stationtimes.begin();
-             it3 != it2->second.stationtimes.end() - 1; it3++) {
-            if (it3->first == id) {
-                std::vector<std::pair<StationID, Time>>::iterator it4 = it3 + 1;
-                result.push_back(it4->first);
-            }
-        }
+    result.reserve(it->second.next_stations.size());
+    for (std::pair<Station*, unsigned int> const& next : it->second.next_stations) {
+        result.push_back(symbols.name(next.first->id));
     }
     return result;
 }
@@ -596,48 +1167,120 @@ std::vector<StationID> Datastructures::next_stations_from(StationID id) {
  *         the given station or if the train or station can't be found or the train doesn't depart
  *         from the given station returns {NO_STATION}
  */
-std::vector<StationID> Datastructures::train_stations_from(StationID stationid, TrainID trainid) {
-    std::unordered_map<StationID, Station>::iterator it = stations.find(stationid);
-    std::unordered_map<TrainID, Train>::iterator it2 = trains.find(trainid);
+std::vector<StationID> Datastructures::train_stations_from(std::string_view stationid, std::string_view trainid) const {
+    OperationTimer timer(*this, StatsOperation::train_stations_from);
+    StationMap::const_iterator it = find_station(stationid);
+    TrainMap::const_iterator it2 = find_train(trainid);
 
     if (it == stations.end() || it2 == trains.end()) {
         return {NO_STATION};
     }
-    bool found_train = false;
-    std::unordered_map<Time, std::unordered_set<TrainID>>::iterator it3 = stations.at(stationid).departures.begin();
-    for (; it3 != stations.at(stationid).departures.end(); it3++) {
-        std::unordered_set<TrainID>::iterator it4 = it3->second.find(trainid);
-        if (it4 != it3->second.end()) {
-            found_train = true;
-            break;
-        }
+    std::pmr::unordered_map<Train const*, std::size_t>::const_iterator stop = it->second.train_stops.find(&it2->second);
+    if (stop == it->second.train_stops.end()) {
+        return {NO_STATION};
     }
-    if (found_train == false) {
+    Train const& train = it2->second;
+    Departures const& departures = it->second.departures;
+    std::pair<Time, SymbolTable::Symbol> departure(train.times[stop->second], train.id);
+    Departures::const_iterator found = find_departure(departures, departure.first, departure.second);
+    if (found == departures.end() || *found != departure) {
         return {NO_STATION};
     }
     std::vector<StationID> result;
-    bool found_station = false;
-    for (std::vector<std::pair<StationID, Time>>::iterator i = it2->second.stationtimes.begin(); i != it2->second.stationtimes.end(); i++) {
-        if (found_station == true) {
-            result.push_back(i->first);
-        }
-
-        if (i->first == stationid) {
-            found_station = true;
-        }
-    }
-    if (found_station == false) {
-        return {NO_STATION};
-    } else {
-        return result;
+    result.reserve(train.stops.size() - stop->second - 1);
+    for (std::size_t k = stop->second + 1; k < train.stops.size(); k++) {
+        result.push_back(symbols.name(train.stops[k]->id));
     }
+    return result;
 }
 
 /**
  * @brief Datastructures::clear_trains clears the trains data structures leaving it with a size of 0
+ *        and clears the trains, the next stations and the departures of the trains of the stations. All memory
+ *        of the trains is given back by releasing train_memory.
  */
 void Datastructures::clear_trains() {
-    trains.clear();
+    OperationTimer timer(*this, StatsOperation::clear_trains);
+    std::vector<char> is_train(symbols.size(), 0);
+    for (TrainMap::const_iterator it = trains.begin(); it != trains.end(); it++) {
+        is_train[it->first] = 1;
+    }
+    for (StationMap::iterator it = stations.begin(); it != stations.end(); it++) {
+        Departures& departures = it->second.departures;
+        departures.erase(std::remove_if(departures.begin(), departures.end(),
+                                        [&is_train](std::pair<Time, SymbolTable::Symbol> const& departure) { return is_train[departure.second] != 0; }),
+                         departures.end());
+    }
+    TrainMap(&train_memory).swap(trains);
+    train_memory.release();
+    for (StationMap::iterator it = stations.begin(); it != stations.end(); it++) {
+        it->second.train_stops.clear();
+        it->second.next_stations.clear();
+    }
+    graph_dirty = true;
+    mutation_epoch++;
+}
+
+/**
+ * @brief Datastructures::remove_train removes a train, its departures and its next stops from the stations it
+ *        stops at
+ * @param trainid TrainID of the train to be removed
+ * @return true if the train was found and removed, otherwise false
+ */
+bool Datastructures::remove_train(std::string_view trainid) {
+    OperationTimer timer(*this, StatsOperation::remove_train);
+    TrainMap::iterator it = find_train(trainid);
+    if (it == trains.end()) {
+        return false;
+    }
+    remove_train_departures(it->second);
+    unlink_train(it->second);
+    trains.erase(it);
+    graph_dirty = true;
+    mutation_epoch++;
+    return true;
+}
+
+/**
+ * @brief Datastructures::update_train_times replaces the stationtimes of a train and its departures. When the
+ *        train keeps its stops, like when it is only delayed, the trains and next stations of the stations stay
+ *        the same and the station graph is updated in place instead of being rebuilt.
+ * @param trainid TrainID of the train to be updated
+ * @param stationtimes a vector of pairs of the stations the train goes through and departure times
+ *        from those stations
+ * @return true if the train and the stations were found and the train was updated, otherwise false
+ */
+bool Datastructures::update_train_times(std::string_view trainid, std::vector<std::pair<StationID, Time>> const& stationtimes) {
+    OperationTimer timer(*this, StatsOperation::update_train_times);
+    TrainMap::iterator it = find_train(trainid);
+    std::vector<Station*> stops;
+    if (it == trains.end() || !find_stops(stationtimes, stops)) {
+        return false;
+    }
+    Train& train = it->second;
+    bool same_stops = std::equal(stops.begin(), stops.end(), train.stops.begin(), train.stops.end());
+    remove_train_departures(train);
+    if (!same_stops) {
+        unlink_train(train);
+        train.stops.assign(stops.begin(), stops.end());
+    }
+    std::pmr::vector<Time> old_times(train.times.get_allocator());
+    old_times.swap(train.times);
+    train.times.reserve(stationtimes.size());
+    for (std::size_t k = 0; k < stationtimes.size(); k++) {
+        train.times.push_back(stationtimes[k].second);
+        if (k + 1 < stationtimes.size()) {
+            insert_departure(*train.stops[k], train.id, stationtimes[k].second);
+        }
+    }
+    if (same_stops) {
+        retime_graph(train, old_times);
+    } else {
+        link_train(train);
+        graph_dirty = true;
+    }
+    mutation_epoch++;
+    return true;
 }
 
 /**
@@ -649,9 +1292,10 @@ void Datastructures::clear_trains() {
  *         If a route between the stations can't be found, returns an empty vector and if either of the
  *         given stations doesn't exist, returns a {NO_STATION, NO_DISTANCE}
  */
-std::vector<std::pair<StationID, Distance>> Datastructures::route_any(StationID fromid, StationID toid) {
-    std::unordered_map<StationID, Station>::iterator it = stations.find(fromid);
-    std::unordered_map<StationID, Station>::iterator it2 = stations.find(toid);
+std::vector<std::pair<StationID, Distance>> Datastructures::route_any(std::string_view fromid, std::string_view toid) const {
+    OperationTimer timer(*this, StatsOperation::route_any);
+    StationMap::const_iterator it = find_station(fromid);
+    StationMap::const_iterator it2 = find_station(toid);
 
     if (it == stations.end() || it2 == stations.end()) {
         return {std::pair<StationID, Distance>(NO_STATION, NO_DISTANCE)};
@@ -659,56 +1303,15 @@ std::vector<std::pair<StationID, Distance>> Datastructures::route_any(StationID
     if (fromid == toid) {
         return {std::pair<StationID, Distance>(fromid, 0)};
     }
-    std::vector<std::pair<StationID, Distance>> result;
-
-    for (auto it = stations.begin(); it != stations.end(); it++) {
-        it->second.d = 999999;
-        it->second.pi = nullptr;
-    }
-    Station* s = &stations.at(fromid);
-    Station* g = &stations.at(toid);
-    s->d = 0;
-    std::queue<std::pair<Distance, Station*>> Q;
-    Q.push(std::pair<Distance, Station*>({0, s}));
-
-    bool found_station = false;
-    while (!Q.empty()) {
-        if (found_station == true) {
-            break;
-        }
-        auto it = Q.front();
-        Station* u = it.second;
-        Q.pop();
-
-        for (auto it = u->stations_to.begin(); it != u->stations_to.end(); it++) {
-            if (it->second.second->pi == nullptr) {
-                it->second.second->d = u->d + distance_between_points(u->location, it->second.second->location);
-                it->second.second->pi = u;
-                Q.push(std::pair<Distance, Station*>({it->second.second->d, it->second.second}));
-            }
-            if (it->second.second->id == toid) {
-                found_station = true;
-                break;
-            }
-        }
-    }
-    result.push_back(std::make_pair(g->id, g->d));
-    Station* i = g->pi;
-
-    while (true) {
-        if (i == nullptr) {
-            return {};
-        } else {
-            result.push_back(std::make_pair(i->id, i->d));
-            if (i->id == fromid) {
-                break;
-            } else {
-                i = i->pi;
-            }
-        }
+    Graph const& graph = current_graph();
+    PooledSearch search(*this);
+    std::uint32_t g = it2->second.index;
+    AnyRoutePolicy policy{{g}};
+    search_graph(*search, graph, it->second.index, policy);
+    if (search->label(g).pi == NO_INDEX) {
+        return {};
     }
-    std::reverse(result.begin(), result.end());
-    return result;
+    return labelled_route(*search, g, &Label::d);
 }
 
 /**
@@ -720,69 +1323,19 @@ std::vector<std::pair<StationID, Distance>> Datastructures::route_any(StationID
  *         If a route between the stations can't be found, returns an empty vector and if either of the
  *         given stations doesn't exist, returns a {NO_STATION, NO_DISTANCE}
  */
-std::vector<std::pair<StationID, Distance>> Datastructures::route_least_stations(StationID fromid, StationID toid) {
-    std::unordered_map<StationID, Station>::iterator it = stations.find(fromid);
-    std::unordered_map<StationID, Station>::iterator it2 = stations.find(toid);
-
-    if (it == stations.end() || it2 == stations.end()) {
-        return {std::pair<StationID, Distance>(NO_STATION, NO_DISTANCE)};
-    }
-    if (fromid == toid) {
-        return {std::pair<StationID, Distance>(fromid, 0)};
+std::vector<std::pair<StationID, Distance>> Datastructures::route_least_stations(std::string_view fromid, std::string_view toid) const {
+    OperationTimer timer(*this, StatsOperation::route_least_stations);
+    if (!route_cache.enabled()) {
+        PooledSearch search(*this);
+        return least_stations_route(*search, fromid, toid);
     }
+    std::string key = cache_key('l', fromid, toid, 0);
     std::vector<std::pair<StationID, Distance>> result;
-
-    for (auto it = stations.begin(); it != stations.end(); it++) {
-        it->second.d = 999999;
-        it->second.de = 999999;
-        it->second.pi = nullptr;
-    }
-    Station* s = &stations.at(fromid);
-    Station* g = &stations.at(toid);
-    s->d = 0;
-    s->de = 0;
-    std::queue<std::pair<Distance, Station*>> Q;
-    Q.push(std::pair<Distance, Station*>({0, s}));
-
-    bool found_station = false;
-    while (!Q.empty()) {
-        if (found_station == true) {
-            break;
-        }
-        auto it = Q.front();
-        Station* u = it.second;
-        Q.pop();
-
-        for (auto it = u->stations_to.begin(); it != u->stations_to.end(); it++) {
-            if (it->second.second->pi == nullptr) {
-                it->second.second->d = u->d + 1;
-                it->second.second->de = u->de + distance_between_points(u->location, it->second.second->location);
-                it->second.second->pi = u;
-                Q.push(std::pair<Distance, Station*>({it->second.second->d, it->second.second}));
-            }
-            if (it->second.second->id == toid) {
-                found_station = true;
-                break;
-            }
-        }
-    }
-    result.push_back(std::make_pair(g->id, g->de));
-    Station* i = g->pi;
-
-    while (true) {
-        if (i == nullptr) {
-            return {};
-        } else {
-            if (i->id == fromid) {
-                result.push_back(std::make_pair(i->id, 0));
-                break;
-            } else {
-                result.push_back(std::make_pair(i->id, i->de));
-                i = i->pi;
-            }
-        }
+    if (!route_cache.find(key, mutation_epoch, result)) {
+        PooledSearch search(*this);
+        result = least_stations_route(*search, fromid, toid);
+        route_cache.insert(std::move(key), mutation_epoch, result);
     }
-    std::reverse(result.begin(), result.end());
     return result;
 }
 
@@ -793,42 +1346,45 @@ std::vector<std::pair<StationID, Distance>> Datastructures::route_least_stations
  * @return a vector of ids of the stations. Last station is the station that causes the cycle. Returns cycle isn't
  *         found, returns an empty vector and if the station can't be found, returns {NO_STATION}
  */
-std::vector<StationID> Datastructures::route_with_cycle(StationID fromid) {
-    std::unordered_map<StationID, Station>::iterator it = stations.find(fromid);
+std::vector<StationID> Datastructures::route_with_cycle(std::string_view fromid) const {
+    OperationTimer timer(*this, StatsOperation::route_with_cycle);
+    StationMap::const_iterator it = find_station(fromid);
 
     if (it == stations.end()) {
         return {NO_STATION};
     }
-    std::vector<StationID> result;
-
-    for (auto it = stations.begin(); it != stations.end(); it++) {
-        it->second.color = 0;
-        it->second.pi = nullptr;
-    }
-    Station* s = &stations.at(fromid);
-    Station* g = nullptr;
-    Station* cycled = nullptr;
+    Graph const& graph = current_graph();
+    PooledSearch search(*this);
+    std::uint32_t s = it->second.index;
+    std::uint32_t g = NO_INDEX;
+    std::uint32_t cycled = NO_INDEX;
     bool found_cycle = false;
-    std::stack<Station*> S;
-    S.push(s);
+    search->frontier.push_back(s);
+    search->counters.push(false);
 
-    while (!S.empty()) {
+    while (!search->frontier.empty()) {
         if (found_cycle == true) {
             break;
         }
-        Station* u = S.top();
-        S.pop();
-
-        if (u->color == 0) {
-            u->color = 1;
-            S.push(u);
-            for (auto it = u->stations_to.begin(); it != u->stations_to.end(); it++) {
-                if (it->second.second->color == 0) {
-                    it->second.second->pi = u;
-                    S.push(it->second.second);
-                } else if (it->second.second->color == 1) {
+        std::uint32_t u = search->frontier.back();
+        search->frontier.pop_back();
+
+        if (search->label(u).color == 0) {
+            search->label(u).color = 1;
+            search->frontier.push_back(u);
+            search->counters.settle();
+            search->counters.push(false);
+            for (std::uint32_t e = graph.offsets[u]; e < graph.offsets[u + 1]; e++) {
+                std::uint32_t v = graph.edges[e].to;
+                search->counters.relax();
+                Label& lv = search->label(v);
+                if (lv.color == 0) {
+                    lv.pi = u;
+                    search->frontier.push_back(v);
+                    search->counters.push(false);
+                } else if (lv.color == 1) {
                     g = u;
-                    cycled = it->second.second;
+                    cycled = v;
                     found_cycle = true;
                     break;
                 }
@@ -838,20 +1394,12 @@ std::vector<StationID> Datastructures::route_with_cycle(StationID fromid) {
     if (found_cycle == false) {
         return {};
     }
-    result.push_back(cycled->id);
-    result.push_back(g->id);
-    Station* i = g->pi;
-
-    while (true) {
-        if (i == nullptr) {
-            return {};
-        } else {
-            result.push_back(i->id);
-            if (i->id == s->id) {
-                break;
-            } else {
-                i = i->pi;
-            }
+    std::vector<StationID> result;
+    result.push_back(symbols.name(station_index[cycled]->id));
+    for (std::uint32_t i = g; i != NO_INDEX; i = search->label(i).pi) {
+        result.push_back(symbols.name(station_index[i]->id));
+        if (i == s) {
+            break;
         }
     }
     std::reverse(result.begin(), result.end());
@@ -867,75 +1415,121 @@ std::vector<StationID> Datastructures::route_with_cycle(StationID fromid) {
  *         If a route between the stations can't be found, returns an empty vector and if either of the
  *         given stations doesn't exist, returns a {NO_STATION, NO_DISTANCE}
  */
-std::vector<std::pair<StationID, Distance>> Datastructures::route_shortest_distance(StationID fromid, StationID toid) {
-    std::unordered_map<StationID, Station>::iterator it = stations.find(fromid);
-    std::unordered_map<StationID, Station>::iterator it2 = stations.find(toid);
-
-    if (it == stations.end() || it2 == stations.end()) {
-        return {std::pair<StationID, Distance>(NO_STATION, NO_DISTANCE)};
-    }
-    if (fromid == toid) {
-        return {std::pair<StationID, Distance>(fromid, 0)};
+std::vector<std::pair<StationID, Distance>> Datastructures::route_shortest_distance(std::string_view fromid, std::string_view toid) const {
+    OperationTimer timer(*this, StatsOperation::route_shortest_distance);
+    if (!route_cache.enabled()) {
+        PooledSearch search(*this);
+        return shortest_distance_route(*search, fromid, toid);
     }
+    std::string key = cache_key('s', fromid, toid, 0);
     std::vector<std::pair<StationID, Distance>> result;
-
-    for (auto it = stations.begin(); it != stations.end(); it++) {
-        it->second.color = 0;
-        it->second.d = 999999;
-        it->second.de = 999999;
-        it->second.pi = nullptr;
+    if (!route_cache.find(key, mutation_epoch, result)) {
+        PooledSearch search(*this);
+        result = shortest_distance_route(*search, fromid, toid);
+        route_cache.insert(std::move(key), mutation_epoch, result);
     }
-    Station* s = &stations.at(fromid);
-    Station* g = &stations.at(toid);
-    s->d = 0;
-    std::set<std::pair<Distance, Station*>> Q;
-    Q.insert(std::pair<Distance, Station*>({0, s}));
-
-    while (!Q.empty()) {
-        auto it = Q.begin();
-        Station* u = it->second;
-        Q.erase(it);
+    return result;
+}
 
-        if (u->id == g->id) {
-            break;
+/**
+ * @brief Datastructures::distance_matrix returns the shortest distances from every origin to every destination
+ *        like the distances of route_shortest_distance. Runs one Dijkstra-algorithm per origin instead of a search per
+ *        pair, which stops after all of the destinations are found. The origins are run on the worker pool, each
+ *        worker with its own search context, so the searches don't share any state.
+ * @param origins StationIDs of the stations to start from
+ * @param destinations StationIDs of the stations to go to
+ * @return the distances in a vector of origins.size() * destinations.size() values, in which the distance from
+ *         origins[i] to destinations[j] is at i * destinations.size() + j. NO_DISTANCE if there is no route or either
+ *         of the stations doesn't exist.
+ */
+std::vector<Distance> Datastructures::distance_matrix(std::vector<StationID> const& origins, std::vector<StationID> const& destinations) const {
+    OperationTimer timer(*this, StatsOperation::distance_matrix);
+    std::size_t m = destinations.size();
+    std::vector<Distance> result(origins.size() * m, NO_DISTANCE);
+    if (result.empty()) {
+        return result;
+    }
+    Graph const& graph = current_graph();
+    std::vector<std::uint32_t> targets(m, NO_INDEX);
+    std::vector<char> is_target(station_index.size(), 0);
+    std::size_t target_count = 0;
+    for (std::size_t j = 0; j < m; j++) {
+        StationMap::const_iterator it = find_station(destinations[j]);
+        if (it != stations.end()) {
+            targets[j] = it->second.index;
+            target_count += is_target[targets[j]] == 0;
+            is_target[targets[j]] = 1;
         }
-        for (auto it = u->stations_to.begin(); it != u->stations_to.end(); it++) {
-            Distance de = it->second.second->de;
-            relax_astar(u, it->second.second, g);
-            if (it->second.second->color == 0) {
-                it->second.second->color = 1;
-                Q.insert(std::pair<Distance, Station*>({it->second.second->de, it->second.second}));
-            } else {
-                if (de > it->second.second->de) {
-                    std::pair<Distance, Station*> pair = std::make_pair(it->second.second->de, it->second.second);
-                    auto it2 = Q.find(pair);
-                    if (it2 != Q.end()) {
-                        Q.erase(it2);
-                        Q.insert(pair);
-                    }
-                }
-            }
+    }
+    std::vector<std::uint32_t> sources(origins.size(), NO_INDEX);
+    for (std::size_t i = 0; i < origins.size(); i++) {
+        StationMap::const_iterator it = find_station(origins[i]);
+        if (it != stations.end()) {
+            sources[i] = it->second.index;
         }
     }
-    result.push_back(std::make_pair(g->id, g->d));
-    Station* i = g->pi;
 
-    while (true) {
-        if (i == nullptr) {
-            return {};
+    WorkStealingPool& pool = worker_pool();
+    std::vector<std::unique_ptr<PooledSearch>> searches(pool.size());
+    pool.run(sources.size(), [&](std::size_t worker, std::size_t i) {
+        if (sources[i] == NO_INDEX || target_count == 0) {
+            return;
+        }
+        if (!searches[worker]) {
+            searches[worker] = std::make_unique<PooledSearch>(*this);
         } else {
-            result.push_back(std::make_pair(i->id, i->d));
-            if (i->id == fromid) {
-                break;
-            } else {
-                i = i->pi;
+            (*searches[worker])->reset(station_index.size());
+        }
+        SearchContext& search = **searches[worker];
+        distances_from(search, graph, sources[i], is_target, target_count);
+        for (std::size_t j = 0; j < m; j++) {
+            if (targets[j] != NO_INDEX && search.label(targets[j]).color == 2) {
+                result[i * m + j] = search.label(targets[j]).d;
             }
         }
-    }
-    std::reverse(result.begin(), result.end());
+    });
     return result;
 }
 
+/**
+ * @brief Datastructures::route_queries runs a batch of route searches on the worker pool and returns their routes
+ *        in the order of the queries. Every worker borrows one search context for the whole batch and resets it
+ *        between its queries.
+ * @param queries the route searches
+ * @return the routes of the queries, each in the member of RouteQueryResult for its kind
+ */
+std::vector<RouteQueryResult> Datastructures::route_queries(std::vector<RouteQuery> const& queries) const {
+    OperationTimer timer(*this, StatsOperation::route_queries);
+    std::vector<RouteQueryResult> results(queries.size());
+    if (queries.empty()) {
+        return results;
+    }
+    current_graph();
+    WorkStealingPool& pool = worker_pool();
+    std::vector<std::unique_ptr<PooledSearch>> searches(pool.size());
+    pool.run(queries.size(), [&](std::size_t worker, std::size_t i) {
+        if (!searches[worker]) {
+            searches[worker] = std::make_unique<PooledSearch>(*this);
+        } else {
+            (*searches[worker])->reset(station_index.size());
+        }
+        SearchContext& search = **searches[worker];
+        RouteQuery const& query = queries[i];
+        switch (query.kind) {
+            case RouteQueryKind::least_stations:
+                results[i].route = least_stations_route(search, query.fromid, query.toid);
+                break;
+            case RouteQueryKind::shortest_distance:
+                results[i].route = shortest_distance_route(search, query.fromid, query.toid);
+                break;
+            case RouteQueryKind::earliest_arrival:
+                results[i].timed_route = earliest_arrival_route(search, query.fromid, query.toid, query.starttime);
+                break;
+        }
+    });
+    return results;
+}
+
 /**
  * @brief Datastructures::route_earliest_arrival returns a route with the earliest arrival time between the start station and end station
  *        in a vector of pairs, which has the stations of the route in other spot and the departure times from the stations in the other spot.
@@ -946,153 +1540,2574 @@ std::vector<std::pair<StationID, Distance>> Datastructures::route_shortest_dista
  *         If a route between the stations can't be found, returns an empty vector and if either of the
  *         given stations doesn't exist, returns a {NO_STATION, NO_DISTANCE}
  */
-std::vector<std::pair<StationID, Time>> Datastructures::route_earliest_arrival(StationID fromid, StationID toid, Time starttime) {
-    std::unordered_map<StationID, Station>::iterator it = stations.find(fromid);
-    std::unordered_map<StationID, Station>::iterator it2 = stations.find(toid);
+std::vector<std::pair<StationID, Time>> Datastructures::route_earliest_arrival(std::string_view fromid, std::string_view toid, Time starttime) const {
+    OperationTimer timer(*this, StatsOperation::route_earliest_arrival);
+    PooledSearch search(*this);
+    return earliest_arrival_route(*search, fromid, toid, starttime);
+}
+
+/**
+ * @brief Datastructures::route_earliest_arrival_profile returns the routes with the earliest arrival times between
+ *        the start station and end station for all of the departure times between the begintime and the endtime.
+ *        Scans the connections backwards by the departure time and keeps for every station the journeys to the end
+ *        station, which aren't beaten by a journey departing later and arriving earlier or at the same time.
+ * @param fromid StationID of the station to start the routes from
+ * @param toid StationID of the station where the routes end
+ * @param begintime Time of the earliest departure
+ * @param endtime Time of the latest departure
+ * @return a vector of routes ordered by the departure time, each a vector of pairs of the stations of the route
+ *         and the departure times from them like in route_earliest_arrival. If either of the given stations
+ *         doesn't exist, returns {{NO_STATION, NO_TIME}}
+ */
+std::vector<std::vector<std::pair<StationID, Time>>> Datastructures::route_earliest_arrival_profile(std::string_view fromid, std::string_view toid,
+                                                                                                    Time begintime, Time endtime) const {
+    OperationTimer timer(*this, StatsOperation::route_earliest_arrival_profile);
+    StationMap::const_iterator it = find_station(fromid);
+    StationMap::const_iterator it2 = find_station(toid);
 
     if (it == stations.end() || it2 == stations.end()) {
-        return {std::pair<StationID, Time>(NO_STATION, NO_TIME)};
+        return {{std::pair<StationID, Time>(NO_STATION, NO_TIME)}};
     }
     if (fromid == toid) {
-        return {std::pair<StationID, Time>(fromid, starttime)};
-    }
-    std::vector<std::pair<StationID, Time>> result;
-
-    for (auto it = stations.begin(); it != stations.end(); it++) {
-        it->second.color = 0;
-        it->second.d = 999999;
-        it->second.pi = nullptr;
+        return {{std::pair<StationID, Time>(fromid, begintime)}};
     }
-    Station* s = &stations.at(fromid);
-    Station* g = &stations.at(toid);
-    s->d = starttime;
-
-    std::set<std::pair<Time, Station*>> Q;
-    Q.insert(std::pair<Time, Station*>({0, s}));
-
-    while (!Q.empty()) {
-        auto it = Q.begin();
-        Station* u = it->second;
-        Q.erase(it);
+    Graph const& graph = current_graph();
+    PooledSearch search(*this);
+    std::vector<Connection> const& connections = graph.connections;
+    std::uint32_t s = it->second.index;
+    std::uint32_t g = it2->second.index;
+    // Journeys from the station departing at the given time or later are before the returned iterator
+    auto departing_at = [](std::vector<ProfileEntry> const& journeys, Time time) {
+        return std::lower_bound(journeys.begin(), journeys.end(), time,
+                                [](ProfileEntry const& entry, Time t) { return entry.departure >= t; });
+    };
+    // Adds a journey departing earlier than the ones already kept, if it also arrives earlier
+    auto add_journey = [](std::vector<ProfileEntry>& journeys, ProfileEntry journey) {
+        if (journeys.empty() || journey.arrival < journeys.back().arrival) {
+            if (!journeys.empty() && journeys.back().departure == journey.departure) {
+                journeys.pop_back();
+            }
+            journeys.push_back(journey);
+        }
+    };
+    // Journeys from the start station departing between the begintime and the endtime. These are kept
+    // apart from the journeys of the start station, since a journey departing after the endtime can
+    // beat them but isn't part of the result.
+    std::vector<ProfileEntry> window;
+    std::vector<Connection>::const_iterator first = std::lower_bound(
+        connections.begin(), connections.end(), begintime, [](Connection const& c, Time t) { return c.departure < t; });
 
-        if (u->id == g->id) {
-            break;
+    for (std::vector<Connection>::const_iterator c = connections.end(); c != first;) {
+        c--;
+        search->counters.relax();
+        // Connections without travel time could be followed by connections departing at the same time,
+        // which aren't scanned yet
+        if (c->arrival <= c->departure || c->from == g) {
+            continue;
         }
-        for (auto it = u->stations_to.begin(); it != u->stations_to.end(); it++) {
-            Time d = it->second.second->d;
-            relax_dijkstra(u, it->second.second, it->first, it->second.first);
-            if (it->second.second->color == 0) {
-                it->second.second->color = 1;
-                Q.insert(std::pair<Time, Station*>({it->second.second->d, it->second.second}));
-            } else {
-                if (d > it->second.second->d) {
-                    std::pair<Distance, Station*> pair = std::make_pair(it->second.second->d, it->second.second);
-                    auto it2 = Q.find(pair);
-                    if (it2 != Q.end()) {
-                        Q.erase(it2);
-                        Q.insert(pair);
-                    }
-                }
+        Time arrival = c->arrival;
+        if (c->to != g) {
+            std::vector<ProfileEntry> const& next = search->profile(c->to);
+            std::vector<ProfileEntry>::const_iterator continuation = departing_at(next, c->arrival);
+            if (continuation == next.begin()) {
+                continue;
             }
+            arrival = (continuation - 1)->arrival;
+        }
+        ProfileEntry journey = {c->departure, arrival, (std::uint32_t)(c - connections.begin())};
+        add_journey(search->profile(c->from), journey);
+        if (c->from == s && c->departure <= endtime) {
+            add_journey(window, journey);
         }
     }
-    Station* i = g->pi;
-    Time prev_arrival = starttime;
-    std::vector<Station*> path;
-    path.push_back(g);
-
-    while (true) {
-        if (i == nullptr) {
-            return {};
-        } else {
-            path.push_back(i);
-            if (i->id == fromid) {
+    std::vector<std::vector<std::pair<StationID, Time>>> result;
+    result.reserve(window.size());
+    for (std::vector<ProfileEntry>::reverse_iterator entry = window.rbegin(); entry != window.rend(); entry++) {
+        std::vector<std::pair<StationID, Time>> route;
+        Connection const* c = &connections[entry->via];
+        while (true) {
+            route.push_back(std::make_pair(symbols.name(station_index[c->from]->id), c->departure));
+            if (c->to == g) {
                 break;
-            } else {
-                i = i->pi;
             }
+            std::vector<ProfileEntry> const& next = search->profile(c->to);
+            c = &connections[(departing_at(next, c->arrival) - 1)->via];
         }
+        route.push_back(std::make_pair(symbols.name(station_index[g]->id), entry->arrival));
+        result.push_back(std::move(route));
     }
-    Time tracker = 2500;
-    for (auto it = path.rbegin(); it != path.rend(); it++) {
-        if (it < path.rend() - 1) {
-            auto it3 = it + 1;
-            for (auto it2 = (*it)->stations_to.begin(); it2 != (*it)->stations_to.end(); it2++) {
-                if (it2->second.second->id == (*it3)->id) {
-                    if (it2->first < (*it)->d && it2->first >= prev_arrival && it2->second.first <= (*it3)->d) {
-                        (*it)->d = it2->first;
-                        tracker = it2->second.first;
+    return result;
+}
+
+/**
+ * @brief Datastructures::route_earliest_arrival_transfers returns the journeys between the start station and the end
+ *        station, which aren't beaten by a journey with at most as many trains arriving earlier or at the same time.
+ *        Uses RAPTOR, which goes in rounds: round k takes one more train from the stations improved in round k - 1,
+ *        scanning every route through them once from the first such station on. An arrival is kept only if it is
+ *        earlier than the ones found before to the station and to the end station, so every round can improve the
+ *        end station once and adds one journey with k trains.
+ * @param fromid StationID of the station to start the journeys from
+ * @param toid StationID of the station where the journeys end
+ * @param starttime Time of the earliest departure from the start station
+ * @return the journeys ordered by the number of trains, each arriving earlier than the ones before it. If there is
+ *         no route, returns an empty vector and if either of the given stations doesn't exist, returns a journey
+ *         {{NO_STATION, NO_TIME}} without trains
+ */
+std::vector<TransferJourney> Datastructures::route_earliest_arrival_transfers(std::string_view fromid, std::string_view toid, Time starttime) const {
+    OperationTimer timer(*this, StatsOperation::route_earliest_arrival_transfers);
+    StationMap::const_iterator it = find_station(fromid);
+    StationMap::const_iterator it2 = find_station(toid);
+
+    if (it == stations.end() || it2 == stations.end()) {
+        return {TransferJourney{{std::pair<StationID, Time>(NO_STATION, NO_TIME)}, {}}};
+    }
+    if (fromid == toid) {
+        return {TransferJourney{{std::pair<StationID, Time>(fromid, starttime)}, {}}};
+    }
+    std::shared_ptr<TransitRoutes const> routes = current_transit();
+    PooledSearch search(*this);
+    std::uint32_t s = it->second.index;
+    std::uint32_t g = it2->second.index;
+    std::size_t route_count = routes->trip_offsets.size() - 1;
+    if (search->route_positions.size() < route_count) {
+        search->route_positions.resize(route_count, NO_INDEX);
+    }
+    // The earliest arrival to a station is in d and the earliest one before the current round in de. via is the
+    // latest step to the station and color the last round, in which the station was improved.
+    Label& start = search->label(s);
+    start.d = starttime;
+    start.de = starttime;
+    start.via = 0;
+    search->transfer_steps.push_back({starttime, 0, NO_INDEX, NO_INDEX, 0, 0, NO_INDEX});
+    std::vector<std::uint32_t>& improved = search->frontier;
+    std::vector<std::uint32_t>& queued = search->reverse_frontier;
+    improved.push_back(s);
+    search->counters.push(false);
+
+    for (std::uint32_t round = 1; !improved.empty(); round++) {
+        for (std::uint32_t p : improved) {
+            Label& lp = search->label(p);
+            lp.de = lp.d;
+            search->counters.settle();
+            for (std::uint32_t i = routes->station_offsets[p]; i < routes->station_offsets[p + 1]; i++) {
+                RouteStop const& stop = routes->station_routes[i];
+                std::uint32_t& first = search->route_positions[stop.route];
+                if (first == NO_INDEX) {
+                    queued.push_back(stop.route);
+                    first = stop.position;
+                } else if (stop.position < first) {
+                    first = stop.position;
+                }
+            }
+        }
+        improved.clear();
+
+        for (std::uint32_t r : queued) {
+            std::uint32_t first = search->route_positions[r];
+            search->route_positions[r] = NO_INDEX;
+            std::uint32_t route_begin = routes->stop_offsets[r];
+            std::uint32_t length = routes->stop_offsets[r + 1] - route_begin;
+            std::uint32_t trip = NO_INDEX;
+            std::uint32_t board = 0;
+            for (std::uint32_t j = first; j < length; j++) {
+                std::uint32_t p = routes->stops[route_begin + j];
+                Label& lp = search->label(p);
+                search->counters.relax();
+                Time passing = std::numeric_limits<Time>::max();
+                if (trip != NO_INDEX) {
+                    passing = routes->times[routes->time_offsets[trip] + j];
+                    if (passing < lp.d && passing < search->label(g).d) {
+                        lp.d = passing;
+                        search->transfer_steps.push_back({passing, round, r, trip, board, j, lp.via});
+                        lp.via = (std::uint32_t)search->transfer_steps.size() - 1;
+                        if (lp.color != round) {
+                            lp.color = round;
+                            improved.push_back(p);
+                            search->counters.push(false);
+                        }
+                    }
+                }
+                // Takes the first train of the route leaving after the arrival to the station in the earlier rounds,
+                // if it leaves before the train taken. The trains don't overtake each other, so binary search works.
+                if (lp.de <= passing) {
+                    std::uint32_t end = trip == NO_INDEX ? routes->trip_offsets[r + 1] : trip;
+                    std::uint32_t low = routes->trip_offsets[r];
+                    std::uint32_t high = end;
+                    while (low < high) {
+                        std::uint32_t middle = low + (high - low) / 2;
+                        if (routes->times[routes->time_offsets[middle] + j] < lp.de) {
+                            low = middle + 1;
+                        } else {
+                            high = middle;
+                        }
+                    }
+                    if (low != end) {
+                        trip = low;
+                        board = j;
                     }
                 }
             }
-            prev_arrival = tracker;
         }
+        queued.clear();
     }
-    result.reserve(path.size());
-    for (auto i = path.rbegin(); i != path.rend(); i++) {
-        result.push_back(std::make_pair((*i)->id, (*i)->d));
+    return transfer_journeys(*search, *routes, g);
+}
+
+/**
+ * @brief Datastructures::set_timetable_engine sets the search algorithm used by route_earliest_arrival
+ * @param engine TimetableEngine to be used
+ */
+void Datastructures::set_timetable_engine(TimetableEngine engine) {
+    this->engine = engine;
+}
+
+/**
+ * @brief Datastructures::timetable_engine returns the search algorithm used by route_earliest_arrival
+ * @return the TimetableEngine in use
+ */
+TimetableEngine Datastructures::timetable_engine() const {
+    return engine;
+}
+
+/**
+ * @brief Datastructures::set_search_direction sets the direction of the searches of route_least_stations
+ *        and route_shortest_distance
+ * @param direction SearchDirection to be used
+ */
+void Datastructures::set_search_direction(SearchDirection direction) {
+    this->direction = direction;
+    mutation_epoch++;
+}
+
+/**
+ * @brief Datastructures::search_direction returns the direction of the searches of route_least_stations
+ *        and route_shortest_distance
+ * @return the SearchDirection in use
+ */
+SearchDirection Datastructures::search_direction() const {
+    return direction;
+}
+
+/**
+ * @brief Datastructures::set_contraction_hierarchy sets whether route_shortest_distance uses the contraction hierarchy
+ *        and when enabled, starts building the hierarchy in the background right away
+ * @param enabled true to use the hierarchy whenever it is up to date with the graph
+ */
+void Datastructures::set_contraction_hierarchy(bool enabled) {
+    hierarchy_enabled = enabled;
+    mutation_epoch++;
+    if (enabled) {
+        current_graph();
+        current_hierarchy();
+    }
+}
+
+/**
+ * @brief Datastructures::set_result_cache sets how many of the latest different results of each of
+ *        route_least_stations, route_shortest_distance and station_departures_after are kept. The results are
+ *        dropped by any change of the stations, departures or trains.
+ * @param capacity the number of results of each kind, 0 to disable the cache
+ */
+void Datastructures::set_result_cache(std::size_t capacity) {
+    route_cache.set_capacity(capacity);
+    departure_cache.set_capacity(capacity);
+}
+
+/**
+ * @brief Datastructures::result_cache_stats returns the hits, misses and skipped uses of the result cache
+ * @return the hits, misses and skipped uses of all of the cached queries together
+ */
+ResultCacheStats Datastructures::result_cache_stats() const {
+    ResultCacheStats routes = route_cache.stats();
+    ResultCacheStats departures = departure_cache.stats();
+    return {routes.hits + departures.hits, routes.misses + departures.misses, routes.skipped + departures.skipped};
+}
+
+/**
+ * @brief Datastructures::stats returns a snapshot of the counted calls of the operations and the work of the
+ *        route searches. The searches still borrowing a search context aren't counted until they give it back.
+ * @return the counters, all zeros if DATASTRUCTURES_STATS is 0
+ */
+DatastructuresStats Datastructures::stats() const {
+    DatastructuresStats result;
+#if DATASTRUCTURES_STATS
+    for (std::size_t i = 0; i < result.operations.size(); i++) {
+        OperationCounters const& counters = operation_stats[i];
+        result.operations[i].calls = counters.calls.load(std::memory_order_relaxed);
+        result.operations[i].total_nanoseconds = counters.total_nanoseconds.load(std::memory_order_relaxed);
+        for (std::size_t b = 0; b < OperationStats::LATENCY_BUCKETS; b++) {
+            result.operations[i].latency[b] = counters.latency[b].load(std::memory_order_relaxed);
+        }
     }
+    result.search.searches = search_stats.searches.load(std::memory_order_relaxed);
+    result.search.settled = search_stats.settled.load(std::memory_order_relaxed);
+    result.search.relaxed = search_stats.relaxed.load(std::memory_order_relaxed);
+    result.search.pushes = search_stats.pushes.load(std::memory_order_relaxed);
+    result.search.decrease_keys = search_stats.decrease_keys.load(std::memory_order_relaxed);
+    result.search.labels_reset = search_stats.labels_reset.load(std::memory_order_relaxed);
+    result.search.reset_sweeps = search_stats.reset_sweeps.load(std::memory_order_relaxed);
+#endif
     return result;
 }
 
 /**
- * @brief Datastructures::distance_between_points returns the distance between two given Coord points
- * @param a Coord-struct of first point
- * @param b Coord-struct of second point
- * @return Distance ie. int-value between the two points
+ * @brief Datastructures::contraction_hierarchy_ready tells whether the contraction hierarchy has been built for the
+ *        current trains and stations, and starts building it in the background if it has not
+ * @return true if route_shortest_distance can use the hierarchy now, otherwise false
  */
-Distance Datastructures::distance_between_points(Coord a, Coord b) {
-    return sqrt(pow(a.x - b.x, 2) + (pow(a.y - b.y, 2)));
+bool Datastructures::contraction_hierarchy_ready() const {
+    current_graph();
+    return current_hierarchy() != nullptr;
 }
 
 /**
- * @brief Datastructures::regions_recursively helpful function for all_subregions_of_region(), which finds
- *        recursively all of the subregions of a given region and adds them to a given vector
- * @param result the vector where all of the subregions will be added to
- * @param it std::unordered_map<RegionID, Region>::iterator iterator to, whose subregions will be went
- *        through and added. Used to go deep into the hierarchy of the regions
+ * @brief Datastructures::save_snapshot writes all of the stations, regions and trains and the graph of the stations
+ *        to a binary file, which load_snapshot can load without parsing or rebuilding the graph. The snapshot is
+ *        built to a buffer first, so a failed write doesn't depend on how far the building went.
+ * @param path the path of the file to be written, which is replaced if it exists
+ * @return true if the file was written successfully, otherwise false
  */
-void Datastructures::regions_recursively(std::vector<RegionID>& result, std::unordered_map<RegionID, Region>::iterator it) {
-    if (it->second.subregions.size() <= 0) {
-        return;
-    } else {
-        for (auto i = it->second.subregions.begin(); i != it->second.subregions.end(); i++) {
-            result.push_back(*i);
-            std::unordered_map<RegionID, Region>::iterator it2 = regions.find(*i);
-            regions_recursively(result, it2);
+bool Datastructures::save_snapshot(std::string const& path) const {
+    OperationTimer timer(*this, StatsOperation::save_snapshot);
+    std::vector<char> image = snapshot_image();
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(image.data(), image.size());
+    out.close();
+    return !out.fail();
+}
+
+/**
+ * @brief Datastructures::publish makes a copy of all of the data for the readers and replaces the published copy with
+ *        it. The copy is loaded from a snapshot image, so it gets the graph without rebuilding it, and also gets the
+ *        search settings and the capacity of the result cache. The graph and the dense indexes of the copy are the
+ *        same as here, so it shares the contraction hierarchy, if it is up to date, with the same graph_version.
+ *        Its lazily built indexes and the routes of route_earliest_arrival_transfers are built before publishing
+ *        it and it shares the worker pool, so the readers never wait for building them or for joining threads.
+ *        Readers, which still have the old copy, keep using it until they let go of it.
+ * @return true if the copy was published, false if it couldn't be made, in which case the old copy stays published
+ */
+bool Datastructures::publish() {
+    OperationTimer timer(*this, StatsOperation::publish);
+    std::vector<char> image = snapshot_image();
+    std::shared_ptr<Datastructures> copy = std::make_shared<Datastructures>();
+    if (!copy->load_snapshot_image(image.data(), image.size())) {
+        return false;
+    }
+    copy->engine = engine;
+    copy->direction = direction;
+    copy->set_result_cache(route_cache.capacity());
+    copy->hierarchy_enabled = hierarchy_enabled;
+    copy->graph_version = graph_version.load();
+    if (hierarchy_enabled) {
+        // Starts building the hierarchy here if it isn't ready, so a later publish() can hand it over
+        copy->hierarchy = current_hierarchy();
+    }
+    worker_pool();
+    copy->workers = workers;
+    copy->worker_pool();
+    copy->sorted_by_name();
+    copy->sorted_by_distance();
+    copy->current_region_tree();
+    copy->current_transit();
+    // Set last, since from here on the hierarchy and the routes of the copy are read without locking
+    copy->published_copy = true;
+    std::atomic_store(&published_state, std::shared_ptr<Datastructures const>(std::move(copy)));
+    return true;
+}
+
+/**
+ * @brief Datastructures::published returns the latest copy made by publish, which can be queried from any thread
+ *        while this Datastructures is being changed
+ * @return the published Datastructures or nullptr if nothing has been published yet
+ */
+std::shared_ptr<Datastructures const> Datastructures::published() const {
+    return std::atomic_load(&published_state);
+}
+
+/**
+ * @brief Datastructures::snapshot_image builds the binary snapshot of save_snapshot in memory
+ * @return the snapshot, aligned to 8 bytes like load_snapshot_image needs
+ */
+std::vector<char> Datastructures::snapshot_image() const {
+    Graph const& g = current_graph();
+    std::string strings;
+    auto add_string = [&strings](std::string const& s) {
+        SnapshotString result = {strings.size(), s.size()};
+        strings += s;
+        return result;
+    };
+
+    std::vector<SnapshotString> symbol_strings;
+    symbol_strings.reserve(symbols.size());
+    for (SymbolTable::Symbol i = 0; i < symbols.size(); i++) {
+        symbol_strings.push_back(add_string(symbols.name(i)));
+    }
+
+    std::vector<SnapshotStation> station_records;
+    std::vector<SnapshotDeparture> departure_records;
+    station_records.reserve(station_index.size());
+    for (Station const* station : station_index) {
+        station_records.push_back({station->id, (std::uint32_t)station->departures.size(), add_string(station->name),
+                                   station->location, station->region});
+        for (std::pair<Time, SymbolTable::Symbol> const& departure : station->departures) {
+            departure_records.push_back({departure.first, 0, departure.second});
+        }
+    }
+
+    std::vector<SnapshotRegion> region_records;
+    std::vector<Coord> region_coords;
+    region_records.reserve(regions.size());
+    for (RegionMap::const_iterator it = regions.begin(); it != regions.end(); it++) {
+        Region const& region = it->second;
+        region_records.push_back({region.id, region.parent, add_string(region.name), region.coordinates.size()});
+        region_coords.insert(region_coords.end(), region.coordinates.begin(), region.coordinates.end());
+    }
+
+    std::vector<SnapshotTrain> train_records;
+    std::vector<SnapshotStop> stop_records;
+    train_records.reserve(trains.size());
+    for (TrainMap::const_iterator it = trains.begin(); it != trains.end(); it++) {
+        Train const& train = it->second;
+        train_records.push_back({train.id, (std::uint32_t)train.stops.size()});
+        for (std::size_t k = 0; k < train.stops.size(); k++) {
+            stop_records.push_back({train.stops[k]->index, train.times[k], 0});
         }
     }
+
+    SnapshotHeader header = {};
+    std::memcpy(header.magic, "DSSNAP\0\0", sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.symbols = symbol_strings.size();
+    header.stations = station_records.size();
+    header.departures = departure_records.size();
+    header.regions = region_records.size();
+    header.region_coords = region_coords.size();
+    header.trains = train_records.size();
+    header.stops = stop_records.size();
+    header.edges = g.edges.size();
+    header.string_bytes = strings.size();
+
+    std::vector<char> image;
+    append_snapshot_section(image, &header, sizeof(header));
+    append_snapshot_section(image, symbol_strings.data(), symbol_strings.size() * sizeof(SnapshotString));
+    append_snapshot_section(image, station_records.data(), station_records.size() * sizeof(SnapshotStation));
+    append_snapshot_section(image, departure_records.data(), departure_records.size() * sizeof(SnapshotDeparture));
+    append_snapshot_section(image, region_records.data(), region_records.size() * sizeof(SnapshotRegion));
+    append_snapshot_section(image, region_coords.data(), region_coords.size() * sizeof(Coord));
+    append_snapshot_section(image, train_records.data(), train_records.size() * sizeof(SnapshotTrain));
+    append_snapshot_section(image, stop_records.data(), stop_records.size() * sizeof(SnapshotStop));
+    append_snapshot_section(image, g.offsets.data(), g.offsets.size() * sizeof(std::uint32_t));
+    append_snapshot_section(image, g.edges.data(), g.edges.size() * sizeof(Edge));
+    append_snapshot_section(image, g.connections.data(), g.connections.size() * sizeof(Connection));
+    append_snapshot_section(image, strings.data(), strings.size());
+    return image;
 }
 
 /**
- * @brief Datastructures::relax_astar Relax-function for the a-star algorithm used in the route_shortest_distance-method,
- *        which updates the de-value using an estimate of the distance between the points
- * @param u a Station-pointer to the station coming from
- * @param v a Station-pointer to the station to go to
- * @param g a Station-pointer to the station of the destination
+ * @brief Datastructures::load_snapshot replaces all of the data with a snapshot written by save_snapshot. Maps the
+ *        file to memory and copies the records from it to the hash maps, and copies the graph as it is, so it isn't
+ *        rebuilt. Nothing is read from the mapping after loading. The file must not be changed while it is being
+ *        loaded.
+ * @param path the path of the snapshot file
+ * @return true if the snapshot was loaded, otherwise false. The old data is kept if the file can't be mapped or
+ *         isn't a snapshot of this version, but the data structures are left empty if the snapshot is inconsistent.
  */
-void Datastructures::relax_astar(Station* u, Station* v, Station* g) {
-    Distance new_d = distance_between_points(u->location, v->location);
-    if (v->d > (u->d + new_d)) {
-        Distance min_est = distance_between_points(v->location, g->location);
-        v->d = u->d + new_d;
-        v->de = v->d + min_est;
-        v->pi = u;
+bool Datastructures::load_snapshot(std::string const& path) {
+    OperationTimer timer(*this, StatsOperation::load_snapshot);
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(SnapshotHeader)) {
+        ::close(fd);
+        return false;
+    }
+    std::size_t size = info.st_size;
+    void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
     }
+    bool loaded = load_snapshot_image(static_cast<char const*>(mapping), size);
+    ::munmap(mapping, size);
+    return loaded;
 }
 
 /**
- * @brief Datastructures::relax_dijkstra Relax-function for the dijkstra-algorithm used in the route_earliest_arrival-method,
+ * @brief Datastructures::earliest_arrival_dijkstra finds the route with the earliest arrival time with
+ *        Dijkstra-algorithm over the station graph and then fixes the departure times along the route
+ * @param search the SearchContext of the search
+ * @param graph the up-to-date Graph
+ * @param s dense index of the start station
+ * @param g dense index of the end station
+ * @param starttime Time of the starttime to compare to
+ * @return a vector of pairs of the stations of the route and the departure times from them, or an empty
+ *         vector if there is no route
+ */
+std::vector<std::pair<StationID, Time>> Datastructures::earliest_arrival_dijkstra(SearchContext& search, Graph const& graph, std::uint32_t s,
+                                                                                  std::uint32_t g, Time starttime) const {
+    EarliestArrivalPolicy policy{g, starttime};
+    search_graph(search, graph, s, policy);
+    if (search.label(g).pi == NO_INDEX) {
+        return {};
+    }
+    std::vector<std::uint32_t> path;
+    for (std::uint32_t i = g; i != NO_INDEX; i = search.label(i).pi) {
+        path.push_back(i);
+    }
+    Time prev_arrival = starttime;
+    Time tracker = 2500;
+    for (auto it = path.rbegin(); it != path.rend(); it++) {
+        if (it < path.rend() - 1) {
+            std::uint32_t next = *(it + 1);
+            Label& current = search.label(*it);
+            for (std::uint32_t e = graph.offsets[*it]; e < graph.offsets[*it + 1]; e++) {
+                Edge const& edge = graph.edges[e];
+                if (edge.to == next) {
+                    if (edge.departure < current.d && edge.departure >= prev_arrival && edge.arrival <= search.label(next).d) {
+                        current.d = edge.departure;
+                        tracker = edge.arrival;
+                    }
+                }
+            }
+            prev_arrival = tracker;
+        }
+    }
+    std::vector<std::pair<StationID, Time>> result;
+    result.reserve(path.size());
+    for (auto i = path.rbegin(); i != path.rend(); i++) {
+        result.push_back(std::make_pair(symbols.name(station_index[*i]->id), search.label(*i).d));
+    }
+    return result;
+}
+
+/**
+ * @brief Datastructures::earliest_arrival_connection_scan finds the route with the earliest arrival time by
+ *        scanning the connections in the order of the departure times starting from the starttime. A connection
+ *        can be taken if its station has been reached by its departure time. The scan stops at the first
+ *        connection departing after the arrival to the end station, since no later connection can improve it.
+ * @param search the SearchContext of the search
+ * @param graph the up-to-date Graph
+ * @param s dense index of the start station
+ * @param g dense index of the end station
+ * @param starttime Time of the starttime to compare to
+ * @return a vector of pairs of the stations of the route and the departure times from them, the last one
+ *         having the arrival time, or an empty vector if there is no route
+ */
+std::vector<std::pair<StationID, Time>> Datastructures::earliest_arrival_connection_scan(SearchContext& search, Graph const& graph,
+                                                                                         std::uint32_t s, std::uint32_t g,
+                                                                                         Time starttime) const {
+    std::vector<Connection> const& connections = graph.connections;
+    search.label(s).d = starttime;
+    std::vector<Connection>::const_iterator first = std::lower_bound(
+        connections.begin(), connections.end(), starttime, [](Connection const& c, Time t) { return c.departure < t; });
+
+    for (std::vector<Connection>::const_iterator c = first; c != connections.end(); c++) {
+        if (c->departure >= search.label(g).d) {
+            break;
+        }
+        // A connection over midnight arrives before it departs and could lower a label below the departure of
+        // the connection it was reached by, so like relax_dijkstra only connections taking time are taken
+        if (c->arrival <= c->departure) {
+            continue;
+        }
+        search.counters.relax();
+        Label& from = search.label(c->from);
+        if (from.d > c->departure) {
+            continue;
+        }
+        Label& to = search.label(c->to);
+        if (c->arrival < to.d) {
+            to.d = c->arrival;
+            to.via = (std::uint32_t)(c - connections.begin());
+        }
+    }
+    if (search.label(g).via == NO_INDEX) {
+        return {};
+    }
+    std::vector<std::pair<StationID, Time>> result;
+    result.push_back(std::make_pair(symbols.name(station_index[g]->id), search.label(g).d));
+    // Every connection arrives later than the one before it departed, so the route visits a station at most once
+    std::size_t station_count = graph.offsets.size() - 1;
+    std::uint32_t i = g;
+    while (i != s && result.size() <= station_count) {
+        Connection const& c = connections[search.label(i).via];
+        result.push_back(std::make_pair(symbols.name(station_index[c.from]->id), c.departure));
+        i = c.from;
+    }
+    if (i != s) {
+        return {};
+    }
+    std::reverse(result.begin(), result.end());
+    return result;
+}
+
+/**
+ * @brief Datastructures::transfer_journeys builds the journeys of route_earliest_arrival_transfers from the last step
+ *        of every round to the end station. Each train of a journey was taken from a station reached in an earlier round, so the step
+ *        before it is the latest step to that station from an earlier round.
+ * @param search the SearchContext of the finished search
+ * @param routes the TransitRoutes searched
+ * @param g dense index of the end station
+ * @return the journeys ordered by the number of trains
+ */
+std::vector<TransferJourney> Datastructures::transfer_journeys(SearchContext& search, TransitRoutes const& routes, std::uint32_t g) const {
+    std::vector<TransferStep> const& steps = search.transfer_steps;
+    std::vector<TransferJourney> result;
+    std::uint32_t result_round = 0;
+    for (std::uint32_t step = search.label(g).via; step != NO_INDEX; step = steps[step].previous) {
+        // The end station can be improved many times in the same round, of which only the last one is kept
+        if (!result.empty() && steps[step].round == result_round) {
+            continue;
+        }
+        result_round = steps[step].round;
+        std::vector<std::uint32_t> legs;
+        for (std::uint32_t i = step; steps[i].route != NO_INDEX;) {
+            legs.push_back(i);
+            TransferStep const& leg = steps[i];
+            i = search.label(routes.stops[routes.stop_offsets[leg.route] + leg.board]).via;
+            while (steps[i].round >= leg.round) {
+                i = steps[i].previous;
+            }
+        }
+        TransferJourney journey;
+        journey.trains.reserve(legs.size());
+        for (std::vector<std::uint32_t>::reverse_iterator l = legs.rbegin(); l != legs.rend(); l++) {
+            TransferStep const& leg = steps[*l];
+            std::uint32_t route_begin = routes.stop_offsets[leg.route];
+            std::uint32_t times = routes.time_offsets[leg.trip];
+            for (std::uint32_t j = leg.board; j < leg.alight; j++) {
+                Station const* station = station_index[routes.stops[route_begin + j]];
+                journey.route.push_back(std::make_pair(symbols.name(station->id), routes.times[times + j]));
+            }
+            journey.trains.push_back(symbols.name(routes.trip_trains[leg.trip]));
+        }
+        journey.route.push_back(std::make_pair(symbols.name(station_index[g]->id), steps[step].arrival));
+        result.push_back(std::move(journey));
+    }
+    std::reverse(result.begin(), result.end());
+    return result;
+}
+
+/**
+ * @brief Datastructures::current_transit returns the trains grouped to routes for route_earliest_arrival_transfers
+ *        and groups them again first if anything has changed since. Splits the trains to segments at every stop, which
+ *        isn't reached later than the one before it. Sorts the segments by their stops and then by their times, and
+ *        puts every segment of the same stops to the first route, whose last trip it doesn't overtake. A published
+ *        copy returns the routes built by publish without locking, since its trains never change.
+ * @return the up-to-date TransitRoutes
+ */
+std::shared_ptr<Datastructures::TransitRoutes const> Datastructures::current_transit() const {
+    if (published_copy) {
+        return transit;
+    }
+    std::lock_guard<std::mutex> lock(transit_mutex);
+    if (transit && transit->epoch == mutation_epoch) {
+        return transit;
+    }
+    std::shared_ptr<TransitRoutes> routes = std::make_shared<TransitRoutes>();
+    routes->epoch = mutation_epoch;
+    std::vector<TrainSegment> order;
+    order.reserve(trains.size());
+    for (TrainMap::const_iterator it = trains.begin(); it != trains.end(); it++) {
+        std::pmr::vector<Time> const& times = it->second.times;
+        std::uint32_t begin = 0;
+        for (std::uint32_t i = 1; i <= times.size(); i++) {
+            if (i == times.size() || times[i] <= times[i - 1]) {
+                if (i - begin >= 2) {
+                    order.push_back({&it->second, begin, i});
+                }
+                begin = i;
+            }
+        }
+    }
+    auto stops_begin = [](TrainSegment const& a) { return a.train->stops.begin() + a.begin; };
+    auto stops_end = [](TrainSegment const& a) { return a.train->stops.begin() + a.end; };
+    auto times_begin = [](TrainSegment const& a) { return a.train->times.begin() + a.begin; };
+    auto times_end = [](TrainSegment const& a) { return a.train->times.begin() + a.end; };
+    auto same_stops = [&](TrainSegment const& a, TrainSegment const& b) {
+        return std::equal(stops_begin(a), stops_end(a), stops_begin(b), stops_end(b));
+    };
+    std::sort(order.begin(), order.end(), [&](TrainSegment const& a, TrainSegment const& b) {
+        if (!same_stops(a, b)) {
+            return std::lexicographical_compare(stops_begin(a), stops_end(a), stops_begin(b), stops_end(b),
+                                                [](Station const* x, Station const* y) { return x->index < y->index; });
+        }
+        return std::lexicographical_compare(times_begin(a), times_end(a), times_begin(b), times_end(b));
+    });
+
+    routes->stop_offsets.push_back(0);
+    routes->trip_offsets.push_back(0);
+    std::vector<std::vector<TrainSegment>> fifo;
+    for (std::size_t begin = 0; begin < order.size();) {
+        std::size_t end = begin + 1;
+        while (end < order.size() && same_stops(order[begin], order[end])) {
+            end++;
+        }
+        fifo.clear();
+        for (std::size_t i = begin; i < end; i++) {
+            TrainSegment const& segment = order[i];
+            std::vector<std::vector<TrainSegment>>::iterator route =
+                std::find_if(fifo.begin(), fifo.end(), [&](std::vector<TrainSegment> const& trips) {
+                    return std::equal(times_begin(trips.back()), times_end(trips.back()), times_begin(segment),
+                                      [](Time a, Time b) { return a <= b; });
+                });
+            if (route == fifo.end()) {
+                fifo.emplace_back(1, segment);
+            } else {
+                route->push_back(segment);
+            }
+        }
+        for (std::vector<std::vector<TrainSegment>>::const_iterator route = fifo.begin(); route != fifo.end(); route++) {
+            for (std::pmr::vector<Station*>::const_iterator stop = stops_begin(order[begin]); stop != stops_end(order[begin]); stop++) {
+                routes->stops.push_back((*stop)->index);
+            }
+            routes->stop_offsets.push_back(routes->stops.size());
+            for (TrainSegment const& segment : *route) {
+                routes->trip_trains.push_back(segment.train->id);
+                routes->time_offsets.push_back(routes->times.size());
+                routes->times.insert(routes->times.end(), times_begin(segment), times_end(segment));
+            }
+            routes->trip_offsets.push_back(routes->trip_trains.size());
+        }
+        begin = end;
+    }
+
+    std::size_t n = station_index.size();
+    routes->station_offsets.assign(n + 1, 0);
+    for (std::uint32_t stop : routes->stops) {
+        routes->station_offsets[stop + 1]++;
+    }
+    for (std::size_t i = 0; i < n; i++) {
+        routes->station_offsets[i + 1] += routes->station_offsets[i];
+    }
+    routes->station_routes.resize(routes->stops.size());
+    std::vector<std::uint32_t> next_free(routes->station_offsets.begin(), routes->station_offsets.end() - 1);
+    for (std::uint32_t r = 0; r + 1 < routes->stop_offsets.size(); r++) {
+        for (std::uint32_t j = routes->stop_offsets[r]; j < routes->stop_offsets[r + 1]; j++) {
+            routes->station_routes[next_free[routes->stops[j]]++] = {r, j - routes->stop_offsets[r]};
+        }
+    }
+    transit = routes;
+    return transit;
+}
+
+/**
+ * @brief Datastructures::insert_station adds a station like add_station and moves the given attributes to it.
+ *        Uses std::unordered_map::try_emplace, so the StationID is hashed only once.
+ * @param id StationID of the station to be added
+ * @param name Name of the station to be added
+ * @param xy Coord-struct ie. location of the station to be added
+ * @return true if the station was added successfully, otherwise false
+ */
+bool Datastructures::insert_station(StationID&& id, Name&& name, Coord xy) {
+    if (id == NO_STATION || name == NO_NAME || xy == NO_COORD) {
+        return false;
+    }
+    SymbolTable::Symbol symbol = symbols.intern(id);
+    std::pair<StationMap::iterator, bool> inserted = stations.try_emplace(symbol);
+    if (!inserted.second) {
+        return false;
+    }
+    Station* station = &inserted.first->second;
+    station->id = symbol;
+    station->name = std::move(name);
+    station->location = xy;
+    station->index = station_index.size();
+    station_index.push_back(station);
+    if (stations.size() >= grid_rebuild_at) {
+        rebuild_station_grid();
+    } else {
+        index_station(station);
+    }
+    stations_by_name_dirty = true;
+    stations_by_distance_dirty = true;
+    graph_dirty = true;
+    mutation_epoch++;
+    return true;
+}
+
+/**
+ * @brief Datastructures::insert_region adds a region like add_region and moves the given attributes to it
+ * @param id RegionID of the region to be added
+ * @param name Name of the region to be added
+ * @param coords vector of the coordinates ie. Coord-structs of the region
+ * @return true if the region didn't already exist and it was added successfully, otherwise false
+ */
+bool Datastructures::insert_region(RegionID id, Name&& name, std::vector<Coord>&& coords) {
+    std::pair<RegionMap::iterator, bool> inserted = regions.try_emplace(id);
+    if (!inserted.second) {
+        return false;
+    }
+    Region& region = inserted.first->second;
+    region.id = id;
+    region.name = std::move(name);
+    region.coordinates = std::move(coords);
+    region_tree_dirty = true;
+    return true;
+}
+
+/**
+ * @brief Datastructures::find_station searches the stations with the given StationID. Finds the symbol
+ *        of the StationID first, so there is no station if there is no symbol.
+ * @param id StationID of the station to be searched
+ * @return an iterator to the station or stations.end() if it wasn't found
+ */
+Datastructures::StationMap::iterator Datastructures::find_station(std::string_view id) {
+    SymbolTable::Symbol symbol = symbols.find(id);
+    if (symbol == SymbolTable::NO_SYMBOL) {
+        return stations.end();
+    }
+    return stations.find(symbol);
+}
+
+/**
+ * @brief Datastructures::find_station searches the stations with the given StationID like the non-const version
+ * @param id StationID of the station to be searched
+ * @return a const_iterator to the station or stations.end() if it wasn't found
+ */
+Datastructures::StationMap::const_iterator Datastructures::find_station(std::string_view id) const {
+    SymbolTable::Symbol symbol = symbols.find(id);
+    if (symbol == SymbolTable::NO_SYMBOL) {
+        return stations.end();
+    }
+    return stations.find(symbol);
+}
+
+/**
+ * @brief Datastructures::find_train searches the trains with the given TrainID like find_station
+ * @param id TrainID of the train to be searched
+ * @return an iterator to the train or trains.end() if it wasn't found
+ */
+Datastructures::TrainMap::iterator Datastructures::find_train(std::string_view id) {
+    SymbolTable::Symbol symbol = symbols.find(id);
+    if (symbol == SymbolTable::NO_SYMBOL) {
+        return trains.end();
+    }
+    return trains.find(symbol);
+}
+
+/**
+ * @brief Datastructures::find_train searches the trains with the given TrainID like find_station
+ * @param id TrainID of the train to be searched
+ * @return a const_iterator to the train or trains.end() if it wasn't found
+ */
+Datastructures::TrainMap::const_iterator Datastructures::find_train(std::string_view id) const {
+    SymbolTable::Symbol symbol = symbols.find(id);
+    if (symbol == SymbolTable::NO_SYMBOL) {
+        return trains.end();
+    }
+    return trains.find(symbol);
+}
+
+/**
+ * @brief Datastructures::cache_key makes the key of a query in the result caches
+ * @param kind a character telling the query
+ * @param fromid the first StationID of the query
+ * @param toid the second StationID of the query or empty
+ * @param number the other parameters of the query packed to a number
+ * @return the key, in which the StationIDs are ended by a zero character so different queries can't have the same key
+ */
+std::string Datastructures::cache_key(char kind, std::string_view fromid, std::string_view toid, std::uint64_t number) {
+    std::string key;
+    key.reserve(fromid.size() + toid.size() + 3 + sizeof(number));
+    key.push_back(kind);
+    key.append(fromid).push_back('\0');
+    key.append(toid).push_back('\0');
+    key.append(reinterpret_cast<char const*>(&number), sizeof(number));
+    return key;
+}
+
+/**
+ * @brief Datastructures::distance_between_points returns the distance between two given Coord points
+ * @param a Coord-struct of first point
+ * @param b Coord-struct of second point
+ * @return Distance ie. int-value between the two points
+ */
+Distance Datastructures::distance_between_points(Coord a, Coord b) {
+    return std::sqrt((double)squared_distance(a, b));
+}
+
+/**
+ * @brief Datastructures::grid_cell returns the coordinates of the grid cell of the spatial index,
+ *        which contains the given point
+ * @param xy Coord-struct of the point
+ * @return Coord-struct of the cell coordinates
+ */
+Coord Datastructures::grid_cell(Coord xy) const {
+    auto floor_div = [this](int value) {
+        long long q = value / grid_cell_size;
+        if (value % grid_cell_size < 0) {
+            q--;
+        }
+        return (int)q;
+    };
+    return {floor_div(xy.x), floor_div(xy.y)};
+}
+
+/**
+ * @brief Datastructures::index_station adds a station to the coordinate index and to its grid cell
+ *        and grows the bounding box of the occupied cells if needed
+ * @param station a Station-pointer to the station to be added
+ */
+void Datastructures::index_station(Station* station) {
+    stations_by_coord.insert({station->location, station});
+    Coord cell = grid_cell(station->location);
+    GridCell& in_cell = station_grid[cell];
+    in_cell.xs.push_back(station->location.x);
+    in_cell.ys.push_back(station->location.y);
+    in_cell.stations.push_back(station);
+    if (grid_min == NO_COORD) {
+        grid_min = cell;
+        grid_max = cell;
+    } else {
+        grid_min = {std::min(grid_min.x, cell.x), std::min(grid_min.y, cell.y)};
+        grid_max = {std::max(grid_max.x, cell.x), std::max(grid_max.y, cell.y)};
+    }
+}
+
+/**
+ * @brief Datastructures::unindex_station removes a station from the coordinate index and from its grid cell.
+ *        The bounding box of the occupied cells isn't shrunk, it is only used to limit the searches.
+ * @param station a Station-pointer to the station to be removed
+ */
+void Datastructures::unindex_station(Station* station) {
+    auto range = stations_by_coord.equal_range(station->location);
+    for (auto it = range.first; it != range.second; it++) {
+        if (it->second == station) {
+            stations_by_coord.erase(it);
+            break;
+        }
+    }
+    std::unordered_map<Coord, GridCell, CoordHash>::iterator it = station_grid.find(grid_cell(station->location));
+    if (it != station_grid.end()) {
+        GridCell& in_cell = it->second;
+        std::size_t pos = std::find(in_cell.stations.begin(), in_cell.stations.end(), station) - in_cell.stations.begin();
+        if (pos != in_cell.stations.size()) {
+            in_cell.xs[pos] = in_cell.xs.back();
+            in_cell.ys[pos] = in_cell.ys.back();
+            in_cell.stations[pos] = in_cell.stations.back();
+            in_cell.xs.pop_back();
+            in_cell.ys.pop_back();
+            in_cell.stations.pop_back();
+        }
+        if (in_cell.stations.empty()) {
+            station_grid.erase(it);
+        }
+    }
+}
+
+/**
+ * @brief Datastructures::rebuild_station_grid rebuilds the spatial index with a cell size, which gives
+ *        about two stations per cell on the bounding box of the stations. Called from add_station()
+ *        whenever the number of stations has doubled.
+ */
+void Datastructures::rebuild_station_grid() {
+    Coord low = stations.begin()->second.location;
+    Coord high = low;
+    for (StationMap::const_iterator it = stations.begin(); it != stations.end(); it++) {
+        low = {std::min(low.x, it->second.location.x), std::min(low.y, it->second.location.y)};
+        high = {std::max(high.x, it->second.location.x), std::max(high.y, it->second.location.y)};
+    }
+    double width = std::max(1.0, (double)high.x - low.x);
+    double height = std::max(1.0, (double)high.y - low.y);
+    grid_cell_size = std::max(1, (int)std::min(1e9, std::sqrt(width * height * 2 / stations.size())));
+    grid_rebuild_at = stations.size() * 2;
+
+    stations_by_coord.clear();
+    station_grid.clear();
+    grid_min = NO_COORD;
+    grid_max = NO_COORD;
+    for (StationMap::iterator it = stations.begin(); it != stations.end(); it++) {
+        index_station(&it->second);
+    }
+}
+
+/**
+ * @brief Datastructures::sorted_by_name returns the index of the stations sorted by their names
+ *        and StationIDs and rebuilds it first if the stations have changed since the last call.
+ *        Concurrent readers wait for the one rebuilding it.
+ * @return a reference to the sorted vector of Station-pointers
+ */
+std::vector<Datastructures::Station const*> const& Datastructures::sorted_by_name() const {
+    if (!stations_by_name_dirty.load(std::memory_order_acquire)) {
+        return stations_by_name;
+    }
+    std::lock_guard<std::mutex> lock(index_mutex);
+    if (stations_by_name_dirty.load(std::memory_order_relaxed)) {
+        stations_by_name.clear();
+        stations_by_name.reserve(stations.size());
+        for (StationMap::const_iterator it = stations.begin(); it != stations.end(); it++) {
+            stations_by_name.push_back(&it->second);
+        }
+        std::sort(stations_by_name.begin(), stations_by_name.end(), [this](Station const* a, Station const* b) {
+            if (a->name != b->name) return a->name < b->name;
+            return symbols.name(a->id) < symbols.name(b->id);
+        });
+        stations_by_name_dirty.store(false, std::memory_order_release);
+    }
+    return stations_by_name;
+}
+
+/**
+ * @brief Datastructures::sorted_by_distance returns the index of the stations sorted by their distance
+ *        from (0, 0), then by their coordinates and StationIDs, and rebuilds it first if the stations
+ *        have changed since the last call. Compares the squared distances so no std::sqrt is needed.
+ *        Concurrent readers wait for the one rebuilding it.
+ * @return a reference to the sorted vector of Station-pointers
+ */
+std::vector<Datastructures::Station const*> const& Datastructures::sorted_by_distance() const {
+    if (!stations_by_distance_dirty.load(std::memory_order_acquire)) {
+        return stations_by_distance;
+    }
+    std::lock_guard<std::mutex> lock(index_mutex);
+    if (stations_by_distance_dirty.load(std::memory_order_relaxed)) {
+        std::vector<int> xs;
+        std::vector<int> ys;
+        xs.reserve(stations.size());
+        ys.reserve(stations.size());
+        for (StationMap::const_iterator it = stations.begin(); it != stations.end(); it++) {
+            xs.push_back(it->second.location.x);
+            ys.push_back(it->second.location.y);
+        }
+        std::vector<long long> distances(stations.size());
+        squared_distances({0, 0}, xs.data(), ys.data(), stations.size(), distances.data());
+
+        std::vector<std::pair<long long, Station const*>> keyed;
+        keyed.reserve(stations.size());
+        std::size_t i = 0;
+        for (StationMap::const_iterator it = stations.begin(); it != stations.end(); it++, i++) {
+            keyed.push_back({distances[i], &it->second});
+        }
+        std::sort(keyed.begin(), keyed.end(),
+                  [this](std::pair<long long, Station const*> const& a, std::pair<long long, Station const*> const& b) {
+                      if (a.first != b.first) return a.first < b.first;
+                      if (a.second->location != b.second->location) return a.second->location < b.second->location;
+                      return symbols.name(a.second->id) < symbols.name(b.second->id);
+                  });
+        stations_by_distance.clear();
+        stations_by_distance.reserve(keyed.size());
+        for (std::pair<long long, Station const*> const& p : keyed) {
+            stations_by_distance.push_back(p.second);
+        }
+        stations_by_distance_dirty.store(false, std::memory_order_release);
+    }
+    return stations_by_distance;
+}
+
+/**
+ * @brief Datastructures::station_ids copies the StationIDs of a slice of a sorted station index to a vector
+ * @param sorted the sorted vector of Station-pointers
+ * @param first the rank of the first station to copy
+ * @param count the maximum number of stations to copy
+ * @return a vector of the StationIDs in the slice
+ */
+std::vector<StationID> Datastructures::station_ids(std::vector<Station const*> const& sorted, unsigned int first, unsigned int count) const {
+    std::vector<StationID> result;
+    if (first >= sorted.size()) {
+        return result;
+    }
+    std::size_t last = first + std::min<std::size_t>(count, sorted.size() - first);
+    result.reserve(last - first);
+    for (std::size_t i = first; i < last; i++) {
+        result.push_back(symbols.name(sorted[i]->id));
+    }
+    return result;
+}
+
+/**
+ * @brief Datastructures::current_region_tree returns the ancestor index of the regions and rebuilds it first
+ *        if the regions have changed since the last call. Gives the regions dense indexes, goes through the
+ *        region forest depth first from every root without recursion to make the Euler tour and the pre-order
+ *        and then builds the sparse table over the Euler tour. Concurrent readers wait for the one rebuilding it.
+ * @return a reference to the up-to-date RegionTree
+ */
+Datastructures::RegionTree const& Datastructures::current_region_tree() const {
+    if (!region_tree_dirty.load(std::memory_order_acquire)) {
+        return region_tree;
+    }
+    std::lock_guard<std::mutex> lock(index_mutex);
+    if (!region_tree_dirty.load(std::memory_order_relaxed)) {
+        return region_tree;
+    }
+    RegionTree& tree = region_tree;
+    std::uint32_t n = regions.size();
+    tree.regions.clear();
+    tree.regions.reserve(n);
+    for (RegionMap::const_iterator it = regions.begin(); it != regions.end(); it++) {
+        it->second.index = tree.regions.size();
+        tree.regions.push_back(&it->second);
+    }
+    tree.parent.assign(n, NO_INDEX);
+    tree.depth.assign(n, 0);
+    tree.root.assign(n, NO_INDEX);
+    tree.first.assign(n, NO_INDEX);
+    tree.preorder.clear();
+    tree.preorder.reserve(n);
+    tree.tin.assign(n, NO_INDEX);
+    tree.tout.assign(n, NO_INDEX);
+    tree.boxes.assign(n, RegionBox{});
+    tree.preorder_index.clear();
+    tree.preorder_index.reserve(n);
+    std::vector<std::uint32_t>& offsets = tree.child_offsets;
+    offsets.assign(n + 1, 0);
+    for (std::uint32_t i = 0; i < n; i++) {
+        if (tree.regions[i]->parent != NO_REGION) {
+            tree.parent[i] = regions.at(tree.regions[i]->parent).index;
+            offsets[tree.parent[i] + 1]++;
+        }
+    }
+    for (std::uint32_t i = 0; i < n; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+    std::vector<std::uint32_t>& children = tree.children;
+    children.resize(offsets[n]);
+    std::vector<std::uint32_t> next_free(offsets.begin(), offsets.end() - 1);
+    for (std::uint32_t i = 0; i < n; i++) {
+        if (tree.parent[i] != NO_INDEX) {
+            children[next_free[tree.parent[i]]++] = i;
+        }
+    }
+    std::vector<std::uint32_t> euler;
+    euler.reserve(2 * n);
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> stack;
+    for (std::uint32_t r = 0; r < n; r++) {
+        if (tree.parent[r] != NO_INDEX) {
+            continue;
+        }
+        stack.push_back({r, offsets[r]});
+        tree.root[r] = r;
+        tree.first[r] = euler.size();
+        euler.push_back(r);
+        tree.tin[r] = tree.preorder.size();
+        tree.preorder.push_back(tree.regions[r]->id);
+        tree.preorder_index.push_back(r);
+        while (!stack.empty()) {
+            std::pair<std::uint32_t, std::uint32_t>& top = stack.back();
+            if (top.second == offsets[top.first + 1]) {
+                tree.tout[top.first] = tree.preorder.size();
+                stack.pop_back();
+                if (!stack.empty()) {
+                    euler.push_back(stack.back().first);
+                }
+                continue;
+            }
+            std::uint32_t child = children[top.second++];
+            tree.depth[child] = tree.depth[top.first] + 1;
+            tree.root[child] = r;
+            tree.first[child] = euler.size();
+            euler.push_back(child);
+            tree.tin[child] = tree.preorder.size();
+            tree.preorder.push_back(tree.regions[child]->id);
+            tree.preorder_index.push_back(child);
+            stack.push_back({child, offsets[child]});
+        }
+    }
+    tree.unrooted.clear();
+    for (std::uint32_t i = 0; i < n; i++) {
+        std::vector<Coord> const& polygon = tree.regions[i]->coordinates;
+        if (polygon.size() >= 3) {
+            for (Coord c : polygon) {
+                tree.boxes[i].extend({c, c});
+            }
+        }
+        if (tree.root[i] == NO_INDEX) {
+            tree.unrooted.push_back(i);
+        }
+    }
+    // Going backwards through the pre-order every subtree is finished before its box is added to the parent's
+    tree.subtree_boxes.assign(tree.preorder.size(), RegionBox{});
+    for (std::uint32_t p = tree.preorder.size(); p-- > 0;) {
+        std::uint32_t i = tree.preorder_index[p];
+        tree.subtree_boxes[p].extend(tree.boxes[i]);
+        if (tree.parent[i] != NO_INDEX) {
+            tree.subtree_boxes[tree.tin[tree.parent[i]]].extend(tree.subtree_boxes[p]);
+        }
+    }
+    tree.sparse.assign(1, euler);
+    for (std::uint32_t j = 1; (1u << j) <= euler.size(); j++) {
+        std::vector<std::uint32_t> const& previous = tree.sparse[j - 1];
+        std::vector<std::uint32_t> level(euler.size() + 1 - (1u << j));
+        for (std::uint32_t i = 0; i < level.size(); i++) {
+            std::uint32_t a = previous[i];
+            std::uint32_t b = previous[i + (1u << (j - 1))];
+            level[i] = tree.depth[a] <= tree.depth[b] ? a : b;
+        }
+        tree.sparse.push_back(std::move(level));
+    }
+    region_tree_dirty.store(false, std::memory_order_release);
+    return region_tree;
+}
+
+/**
+ * @brief Datastructures::polygon_contains checks with the even-odd rule if a polygon contains a point by
+ *        counting the edges crossed by a ray from the point to the positive x direction. Uses only integer
+ *        arithmetic, so the result is exact. Points on the edges are inside.
+ * @param polygon the corners of the polygon in order
+ * @param xy Coord-struct of the point
+ * @return true if the polygon has at least 3 corners and it contains the point, otherwise false
+ */
+bool Datastructures::polygon_contains(std::vector<Coord> const& polygon, Coord xy) {
+    if (polygon.size() < 3) {
+        return false;
+    }
+    bool inside = false;
+    for (std::size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+        Coord a = polygon[j];
+        Coord b = polygon[i];
+        long long cross = ((long long)b.x - a.x) * ((long long)xy.y - a.y) - ((long long)b.y - a.y) * ((long long)xy.x - a.x);
+        if (cross == 0 && std::min(a.x, b.x) <= xy.x && xy.x <= std::max(a.x, b.x) && std::min(a.y, b.y) <= xy.y &&
+            xy.y <= std::max(a.y, b.y)) {
+            return true;
+        }
+        // The edge crosses the ray if its ends are on the different sides of it and the point is on the
+        // left of the upward edge or on the right of the downward edge
+        if ((a.y > xy.y) != (b.y > xy.y) && (cross > 0) == (b.y > a.y)) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+/**
+ * @brief Datastructures::subregions_in_cycle finds the subregions of a region, which is in a cycle of parents
+ *        and so not in the pre-order of the region tree. Goes through the subregions depth first with a stack
+ *        and stops at the regions already found, so the cycle is gone through only once.
+ * @param tree the up-to-date RegionTree
+ * @param i dense index of the region
+ * @return a vector of all the subregions, which includes the region itself through the cycle
+ */
+std::vector<RegionID> Datastructures::subregions_in_cycle(RegionTree const& tree, std::uint32_t i) const {
+    std::vector<RegionID> result;
+    std::vector<bool> found(tree.regions.size(), false);
+    std::vector<std::uint32_t> stack(1, i);
+    while (!stack.empty()) {
+        std::uint32_t u = stack.back();
+        stack.pop_back();
+        for (std::uint32_t c = tree.child_offsets[u]; c < tree.child_offsets[u + 1]; c++) {
+            std::uint32_t v = tree.children[c];
+            if (!found[v]) {
+                found[v] = true;
+                result.push_back(tree.regions[v]->id);
+                stack.push_back(v);
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Datastructures::relax_astar Relax-function for the a-star algorithm used in the route_shortest_distance-method,
+ *        which updates the de-value using an estimate of the distance between the points
+ * @param search the SearchContext of the search
+ * @param graph the Graph being searched
+ * @param u dense index of the station coming from
+ * @param e the Edge from u to the station to go to
+ * @param g dense index of the station of the destination
+ */
+void Datastructures::relax_astar(SearchContext& search, Graph const& graph, std::uint32_t u, Edge const& e, std::uint32_t g) {
+    Distance du = search.label(u).d;
+    Label& lv = search.label(e.to);
+    if (lv.d > (du + e.length)) {
+        Distance min_est = distance_between_points(graph.coords[e.to], graph.coords[g]);
+        lv.d = du + e.length;
+        lv.de = lv.d + min_est;
+        lv.pi = u;
+    }
+}
+
+/**
+ * @brief Datastructures::labelled_route builds the route to a station from the pi-values of the labels of a search
+ * @param search the SearchContext of the finished search
+ * @param g dense index of the station where the route ends
+ * @param cost the member of Label, which has the distance travelled to a station
+ * @return a vector of pairs, which has the stations of the route in other spot and the travelled distance in the other spot
+ */
+std::vector<std::pair<StationID, Distance>> Datastructures::labelled_route(SearchContext& search, std::uint32_t g, Distance Label::*cost) const {
+    std::vector<std::pair<StationID, Distance>> result;
+    for (std::uint32_t i = g; i != NO_INDEX; i = search.label(i).pi) {
+        result.push_back(std::make_pair(symbols.name(station_index[i]->id), search.label(i).*cost));
+    }
+    std::reverse(result.begin(), result.end());
+    return result;
+}
+
+/**
+ * @brief Datastructures::least_stations_route finds the route like route_least_stations with the given
+ *        search context, so a worker can reuse one context for many searches
+ * @param search the reset SearchContext of the search
+ * @param fromid StationID of the station to start the route from
+ * @param toid StationID of the station where the route ends
+ * @return the route like route_least_stations returns it
+ */
+std::vector<std::pair<StationID, Distance>> Datastructures::least_stations_route(SearchContext& search, std::string_view fromid, std::string_view toid) const {
+    StationMap::const_iterator it = find_station(fromid);
+    StationMap::const_iterator it2 = find_station(toid);
+
+    if (it == stations.end() || it2 == stations.end()) {
+        return {std::pair<StationID, Distance>(NO_STATION, NO_DISTANCE)};
+    }
+    if (fromid == toid) {
+        return {std::pair<StationID, Distance>(fromid, 0)};
+    }
+    Graph const& graph = current_graph();
+    std::uint32_t s = it->second.index;
+    std::uint32_t g = it2->second.index;
+    if (direction == SearchDirection::bidirectional) {
+        return least_stations_bidirectional(search, graph, s, g);
+    }
+    LeastStationsPolicy policy{g};
+    search_graph(search, graph, s, policy);
+    if (search.label(g).pi == NO_INDEX) {
+        return {};
+    }
+    return labelled_route(search, g, &Label::de);
+}
+
+/**
+ * @brief Datastructures::shortest_distance_route finds the route like route_shortest_distance with the given search context
+ * @param search the reset SearchContext of the search
+ * @param fromid StationID of the station to start the route from
+ * @param toid StationID of the station where the route ends
+ * @return the route like route_shortest_distance returns it
+ */
+std::vector<std::pair<StationID, Distance>> Datastructures::shortest_distance_route(SearchContext& search, std::string_view fromid, std::string_view toid) const {
+    StationMap::const_iterator it = find_station(fromid);
+    StationMap::const_iterator it2 = find_station(toid);
+
+    if (it == stations.end() || it2 == stations.end()) {
+        return {std::pair<StationID, Distance>(NO_STATION, NO_DISTANCE)};
+    }
+    if (fromid == toid) {
+        return {std::pair<StationID, Distance>(fromid, 0)};
+    }
+    Graph const& graph = current_graph();
+    std::uint32_t s = it->second.index;
+    std::uint32_t g = it2->second.index;
+    if (hierarchy_enabled) {
+        std::shared_ptr<ContractionHierarchy const> ch = current_hierarchy();
+        if (ch) {
+            return shortest_distance_hierarchy(search, *ch, graph, s, g);
+        }
+    }
+    if (direction == SearchDirection::bidirectional) {
+        return shortest_distance_bidirectional(search, graph, s, g);
+    }
+    ShortestDistancePolicy policy{g};
+    search_graph(search, graph, s, policy);
+    if (search.label(g).pi == NO_INDEX) {
+        return {};
+    }
+    return labelled_route(search, g, &Label::d);
+}
+
+/**
+ * @brief Datastructures::earliest_arrival_route finds the route like route_earliest_arrival with the given search context
+ * @param search the reset SearchContext of the search
+ * @param fromid StationID of the station to start the route from
+ * @param toid StationID of the station where the route ends
+ * @param starttime Time of the starttime to compare to
+ * @return the route like route_earliest_arrival returns it
+ */
+std::vector<std::pair<StationID, Time>> Datastructures::earliest_arrival_route(SearchContext& search, std::string_view fromid, std::string_view toid, Time starttime) const {
+    StationMap::const_iterator it = find_station(fromid);
+    StationMap::const_iterator it2 = find_station(toid);
+
+    if (it == stations.end() || it2 == stations.end()) {
+        return {std::pair<StationID, Time>(NO_STATION, NO_TIME)};
+    }
+    if (fromid == toid) {
+        return {std::pair<StationID, Time>(fromid, starttime)};
+    }
+    Graph const& graph = current_graph();
+    if (engine == TimetableEngine::dijkstra) {
+        return earliest_arrival_dijkstra(search, graph, it->second.index, it2->second.index, starttime);
+    }
+    return earliest_arrival_connection_scan(search, graph, it->second.index, it2->second.index, starttime);
+}
+
+/**
+ * @brief Datastructures::least_stations_bidirectional finds a route with the least stations with breadth-first
+ *        searches from both of the stations. Expands one whole level at a time from the side with the smaller level.
+ *        Every edge between the two searched parts is a candidate, and after the first level with any candidates
+ *        the one with the least stations is the best route.
+ * @param search the reset SearchContext of the search
+ * @param graph the up-to-date Graph
+ * @param s dense index of the start station
+ * @param g dense index of the end station
+ * @return the route like route_least_stations returns it
+ */
+std::vector<std::pair<StationID, Distance>> Datastructures::least_stations_bidirectional(SearchContext& search, Graph const& graph, std::uint32_t s,
+                                                                                         std::uint32_t g) const {
+    std::vector<std::uint32_t>& forward = search.frontier;
+    std::vector<std::uint32_t>& backward = search.reverse_frontier;
+    search.label(s).d = 0;
+    search.label(s).color = 1;
+    search.reverse_label(g).d = 0;
+    search.reverse_label(g).color = 1;
+    forward.push_back(s);
+    backward.push_back(g);
+    search.counters.push(false);
+    search.counters.push(false);
+
+    std::size_t forward_head = 0;
+    std::size_t backward_head = 0;
+    Distance best = std::numeric_limits<Distance>::max();
+    std::uint32_t meet_from = NO_INDEX;
+    std::uint32_t meet_to = NO_INDEX;
+    while (meet_from == NO_INDEX && forward_head < forward.size() && backward_head < backward.size()) {
+        if (forward.size() - forward_head <= backward.size() - backward_head) {
+            for (std::size_t level_end = forward.size(); forward_head < level_end; forward_head++) {
+                std::uint32_t u = forward[forward_head];
+                Distance du = search.label(u).d;
+                search.counters.settle();
+                for (std::uint32_t e = graph.offsets[u]; e < graph.offsets[u + 1]; e++) {
+                    std::uint32_t v = graph.edges[e].to;
+                    search.counters.relax();
+                    Label const& rv = search.reverse_label(v);
+                    if (rv.color != 0 && du + 1 + rv.d < best) {
+                        best = du + 1 + rv.d;
+                        meet_from = u;
+                        meet_to = v;
+                    }
+                    Label& lv = search.label(v);
+                    if (lv.color == 0) {
+                        lv.color = 1;
+                        lv.d = du + 1;
+                        lv.pi = u;
+                        forward.push_back(v);
+                        search.counters.push(false);
+                    }
+                }
+            }
+        } else {
+            for (std::size_t level_end = backward.size(); backward_head < level_end; backward_head++) {
+                std::uint32_t v = backward[backward_head];
+                Distance dv = search.reverse_label(v).d;
+                search.counters.settle();
+                for (std::uint32_t e = graph.reverse_offsets[v]; e < graph.reverse_offsets[v + 1]; e++) {
+                    std::uint32_t u = graph.reverse_edges[e].to;
+                    search.counters.relax();
+                    Label const& lu = search.label(u);
+                    if (lu.color != 0 && lu.d + 1 + dv < best) {
+                        best = lu.d + 1 + dv;
+                        meet_from = u;
+                        meet_to = v;
+                    }
+                    Label& ru = search.reverse_label(u);
+                    if (ru.color == 0) {
+                        ru.color = 1;
+                        ru.d = dv + 1;
+                        ru.pi = v;
+                        backward.push_back(u);
+                        search.counters.push(false);
+                    }
+                }
+            }
+        }
+    }
+    if (meet_from == NO_INDEX) {
+        return {};
+    }
+    return route_through(search, graph, meet_from, meet_to);
+}
+
+/**
+ * @brief Datastructures::shortest_distance_bidirectional finds the shortest route with Dijkstra-algorithm from both
+ *        of the stations, always continuing the side with the smaller queue. Every edge from a station reached forward
+ *        to a station reached backward is a candidate. The search ends when the smallest keys of the queues together
+ *        are at least the shortest candidate, since no route through an open station can be shorter.
+ * @param search the reset SearchContext of the search
+ * @param graph the up-to-date Graph
+ * @param s dense index of the start station
+ * @param g dense index of the end station
+ * @return the route like route_shortest_distance returns it
+ */
+std::vector<std::pair<StationID, Distance>> Datastructures::shortest_distance_bidirectional(SearchContext& search, Graph const& graph,
+                                                                                            std::uint32_t s, std::uint32_t g) const {
+    QuaternaryHeap<Distance, std::uint32_t>& forward = search.distance_queue;
+    QuaternaryHeap<Distance, std::uint32_t>& backward = search.reverse_distance_queue;
+    search.label(s).d = 0;
+    search.label(s).color = 1;
+    search.reverse_label(g).d = 0;
+    search.reverse_label(g).color = 1;
+    forward.push(0, s);
+    backward.push(0, g);
+    search.counters.push(false);
+    search.counters.push(false);
+
+    Distance best = std::numeric_limits<Distance>::max();
+    std::uint32_t meet_from = NO_INDEX;
+    std::uint32_t meet_to = NO_INDEX;
+    while (!forward.empty() && !backward.empty() && (long long)forward.top().first + backward.top().first < best) {
+        if (forward.size() <= backward.size()) {
+            std::uint32_t u = forward.pop().second;
+            Label& lu = search.label(u);
+            if (lu.color == 2) {
+                continue;
+            }
+            lu.color = 2;
+            search.counters.settle();
+            for (std::uint32_t e = graph.offsets[u]; e < graph.offsets[u + 1]; e++) {
+                Edge const& edge = graph.edges[e];
+                search.counters.relax();
+                Label const& rv = search.reverse_label(edge.to);
+                if (rv.color != 0 && lu.d + edge.length + rv.d < best) {
+                    best = lu.d + edge.length + rv.d;
+                    meet_from = u;
+                    meet_to = edge.to;
+                }
+                Label& lv = search.label(edge.to);
+                if (lv.color != 2 && lv.d > lu.d + edge.length) {
+                    lv.d = lu.d + edge.length;
+                    lv.pi = u;
+                    search.counters.push(lv.color == 1);
+                    lv.color = 1;
+                    forward.push(lv.d, edge.to);
+                }
+            }
+        } else {
+            std::uint32_t v = backward.pop().second;
+            Label& rv = search.reverse_label(v);
+            if (rv.color == 2) {
+                continue;
+            }
+            rv.color = 2;
+            search.counters.settle();
+            for (std::uint32_t e = graph.reverse_offsets[v]; e < graph.reverse_offsets[v + 1]; e++) {
+                Edge const& edge = graph.reverse_edges[e];
+                search.counters.relax();
+                Label const& lu = search.label(edge.to);
+                if (lu.color != 0 && lu.d + edge.length + rv.d < best) {
+                    best = lu.d + edge.length + rv.d;
+                    meet_from = edge.to;
+                    meet_to = v;
+                }
+                Label& ru = search.reverse_label(edge.to);
+                if (ru.color != 2 && ru.d > rv.d + edge.length) {
+                    ru.d = rv.d + edge.length;
+                    ru.pi = v;
+                    search.counters.push(ru.color == 1);
+                    ru.color = 1;
+                    backward.push(ru.d, edge.to);
+                }
+            }
+        }
+    }
+    if (meet_from == NO_INDEX) {
+        return {};
+    }
+    return route_through(search, graph, meet_from, meet_to);
+}
+
+/**
+ * @brief Datastructures::route_through builds the route of a bidirectional search, which met at the edge from u to v:
+ *        the forward labels lead from u back to the start station and the backward ones from v on to the end station.
+ *        The edges between two stations are as long as the distance of the stations, so the distances along the
+ *        route are the sums of the distances between the stations.
+ * @param search the SearchContext of the search
+ * @param graph the up-to-date Graph
+ * @param u dense index of the last station of the forward half
+ * @param v dense index of the first station of the backward half
+ * @return a vector of pairs, which has the stations of the route and the distances travelled to them
+ */
+std::vector<std::pair<StationID, Distance>> Datastructures::route_through(SearchContext& search, Graph const& graph, std::uint32_t u,
+                                                                          std::uint32_t v) const {
+    std::vector<std::uint32_t> route;
+    for (std::uint32_t i = u; i != NO_INDEX; i = search.label(i).pi) {
+        route.push_back(i);
+    }
+    std::reverse(route.begin(), route.end());
+    for (std::uint32_t i = v; i != NO_INDEX; i = search.reverse_label(i).pi) {
+        route.push_back(i);
+    }
+    std::vector<std::pair<StationID, Distance>> result;
+    result.reserve(route.size());
+    Distance travelled = 0;
+    for (std::size_t k = 0; k < route.size(); k++) {
+        if (k > 0) {
+            travelled += distance_between_points(graph.coords[route[k - 1]], graph.coords[route[k]]);
+        }
+        result.push_back(std::make_pair(symbols.name(station_index[route[k]]->id), travelled));
+    }
+    return result;
+}
+
+/**
+ * @brief Datastructures::build_reverse_edges builds the reverse edges of the graph from its edges by counting
+ *        the incoming edges of every station first, so every edge is placed directly to its row
+ * @param graph the Graph, which has its offsets and edges built already
+ */
+void Datastructures::build_reverse_edges(Graph& graph) {
+    std::size_t n = graph.offsets.size() - 1;
+    graph.reverse_offsets.assign(n + 1, 0);
+    for (Edge const& edge : graph.edges) {
+        graph.reverse_offsets[edge.to + 1]++;
+    }
+    for (std::size_t i = 0; i < n; i++) {
+        graph.reverse_offsets[i + 1] += graph.reverse_offsets[i];
+    }
+    graph.reverse_edges.resize(graph.edges.size());
+    std::vector<std::uint32_t> next_free(graph.reverse_offsets.begin(), graph.reverse_offsets.end() - 1);
+    for (std::uint32_t i = 0; i < n; i++) {
+        for (std::uint32_t e = graph.offsets[i]; e < graph.offsets[i + 1]; e++) {
+            Edge reverse = graph.edges[e];
+            reverse.to = i;
+            graph.reverse_edges[next_free[graph.edges[e].to]++] = reverse;
+        }
+    }
+}
+
+/**
+ * @brief Datastructures::current_hierarchy returns the contraction hierarchy if it was built from the current graph.
+ *        Otherwise starts hierarchy_builder, if it isn't running already, and returns nothing, so the caller can
+ *        search without the hierarchy while it is being built. A published copy never builds its own and returns
+ *        the hierarchy given to it by publish without locking, since it is never changed afterwards.
+ * @return the up-to-date ContractionHierarchy or nullptr
+ */
+std::shared_ptr<Datastructures::ContractionHierarchy const> Datastructures::current_hierarchy() const {
+    if (published_copy) {
+        return hierarchy;
+    }
+    std::uint64_t version = graph_version.load();
+    std::lock_guard<std::mutex> lock(hierarchy_mutex);
+    if (hierarchy && hierarchy->version == version) {
+        return hierarchy;
+    }
+    hierarchy_wanted = std::max(hierarchy_wanted, version);
+    if (!hierarchy_building) {
+        if (hierarchy_builder.joinable()) {
+            hierarchy_builder.join();
+        }
+        hierarchy_building = true;
+        hierarchy_builder = std::thread(&Datastructures::build_hierarchies, this);
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Datastructures::build_hierarchies is the loop of hierarchy_builder. Copies the graph, contracts it and
+ *        publishes the hierarchy, and starts again if the graph has changed meanwhile.
+ */
+void Datastructures::build_hierarchies() const {
+    while (true) {
+        std::vector<std::uint32_t> offsets;
+        std::vector<Edge> edges;
+        std::uint64_t version;
+        {
+            std::lock_guard<std::mutex> lock(graph_mutex);
+            offsets = graph.offsets;
+            edges = graph.edges;
+            version = graph_version.load();
+        }
+        std::shared_ptr<ContractionHierarchy> built = contract_graph(offsets, edges, hierarchy_stopping);
+        std::lock_guard<std::mutex> lock(hierarchy_mutex);
+        if (!built) {
+            hierarchy_building = false;
+            return;
+        }
+        built->version = version;
+        hierarchy = std::move(built);
+        if (hierarchy_wanted <= version) {
+            hierarchy_building = false;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Datastructures::contract_graph builds a contraction hierarchy. Contracts first the station with the
+ *        smallest edge difference (shortcuts added minus arcs removed), counting also its contracted neighbours and
+ *        how deep they are in the hierarchy, and checks the priority again when it is taken from the queue. A shortcut from u to x past v is needed only if a witness
+ *        search from u, which doesn't go through v and gives up after a few hundred stations, doesn't find a path
+ *        at most as long.
+ * @param offsets the offsets of the edges of the stations
+ * @param edges the edges, from which only the stations and the lengths are used
+ * @param stopping set when the building should be given up
+ * @return the ContractionHierarchy or nullptr if the building was given up
+ */
+std::shared_ptr<Datastructures::ContractionHierarchy> Datastructures::contract_graph(std::vector<std::uint32_t> const& offsets,
+                                                                                     std::vector<Edge> const& edges,
+                                                                                     std::atomic<bool> const& stopping) {
+    // Stations settled by a witness search when estimating the priority and when contracting
+    std::size_t const estimate_limit = 50;
+    std::size_t const contract_limit = 500;
+    std::uint32_t n = offsets.empty() ? 0 : offsets.size() - 1;
+    std::shared_ptr<ContractionHierarchy> ch = std::make_shared<ContractionHierarchy>();
+
+    // Arcs between the stations not contracted yet, the shortest one of the parallel edges only
+    std::vector<std::vector<HierarchyArc>> out(n);
+    std::vector<std::vector<HierarchyArc>> in(n);
+    auto add_arc = [](std::vector<HierarchyArc>& arcs, std::uint32_t to, Distance length) {
+        for (HierarchyArc& arc : arcs) {
+            if (arc.to == to) {
+                bool shorter = length < arc.length;
+                arc.length = std::min(arc.length, length);
+                return shorter;
+            }
+        }
+        arcs.push_back({to, length});
+        return true;
+    };
+    for (std::uint32_t u = 0; u < n; u++) {
+        for (std::uint32_t e = offsets[u]; e < offsets[u + 1]; e++) {
+            if (edges[e].to != u) {
+                add_arc(out[u], edges[e].to, edges[e].length);
+                add_arc(in[edges[e].to], u, edges[e].length);
+            }
+        }
+    }
+
+    std::vector<std::uint32_t> contracted_neighbours(n, 0);
+    std::vector<std::uint32_t> level(n, 0);
+    std::vector<Distance> witness(n, std::numeric_limits<Distance>::max());
+    std::vector<std::uint32_t> touched;
+    QuaternaryHeap<Distance, std::uint32_t> queue;
+    // Shortest distances from u to the stations not contracted yet without going through v, up to limit
+    auto witness_search = [&](std::uint32_t u, std::uint32_t v, Distance limit, std::size_t settle_limit) {
+        for (std::uint32_t i : touched) {
+            witness[i] = std::numeric_limits<Distance>::max();
+        }
+        touched.clear();
+        queue.clear();
+        witness[u] = 0;
+        touched.push_back(u);
+        queue.push(0, u);
+        for (std::size_t settled = 0; !queue.empty() && settled < settle_limit; settled++) {
+            std::pair<Distance, std::uint32_t> top = queue.pop();
+            if (top.first > witness[top.second]) {
+                continue;
+            }
+            if (top.first > limit) {
+                break;
+            }
+            for (HierarchyArc const& arc : out[top.second]) {
+                if (arc.to != v && top.first + arc.length < witness[arc.to]) {
+                    if (witness[arc.to] == std::numeric_limits<Distance>::max()) {
+                        touched.push_back(arc.to);
+                    }
+                    witness[arc.to] = top.first + arc.length;
+                    queue.push(witness[arc.to], arc.to);
+                }
+            }
+        }
+    };
+    // Calls shortcut(u, x, length) for every shortcut the contraction of v needs
+    auto shortcuts_of = [&](std::uint32_t v, std::size_t settle_limit, auto shortcut) {
+        Distance longest_out = 0;
+        for (HierarchyArc const& arc : out[v]) {
+            longest_out = std::max(longest_out, arc.length);
+        }
+        for (HierarchyArc const& from : in[v]) {
+            witness_search(from.to, v, from.length + longest_out, settle_limit);
+            for (HierarchyArc const& to : out[v]) {
+                if (to.to != from.to && witness[to.to] > from.length + to.length) {
+                    shortcut(from.to, to.to, from.length + to.length);
+                }
+            }
+        }
+    };
+    auto priority = [&](std::uint32_t v) {
+        int added = 0;
+        shortcuts_of(v, estimate_limit, [&added](std::uint32_t, std::uint32_t, Distance) { added++; });
+        return 2 * (added - (int)(in[v].size() + out[v].size())) + (int)contracted_neighbours[v] + (int)level[v];
+    };
+
+    QuaternaryHeap<int, std::uint32_t> order;
+    for (std::uint32_t v = 0; v < n; v++) {
+        order.push(priority(v), v);
+    }
+    std::vector<std::vector<HierarchyArc>> up(n);
+    std::vector<std::vector<HierarchyArc>> down(n);
+    while (!order.empty()) {
+        if (stopping) {
+            return nullptr;
+        }
+        std::uint32_t v = order.pop().second;
+        int current = priority(v);
+        if (!order.empty() && current > order.top().first) {
+            order.push(current, v);
+            continue;
+        }
+        up[v] = out[v];
+        down[v] = in[v];
+        shortcuts_of(v, contract_limit, [&](std::uint32_t u, std::uint32_t x, Distance length) {
+            if (add_arc(out[u], x, length)) {
+                add_arc(in[x], u, length);
+                ch->shortcuts[(std::uint64_t)u << 32 | x] = v;
+            }
+        });
+        for (HierarchyArc const& arc : in[v]) {
+            std::vector<HierarchyArc>& arcs = out[arc.to];
+            arcs.erase(std::remove_if(arcs.begin(), arcs.end(), [v](HierarchyArc const& a) { return a.to == v; }), arcs.end());
+            contracted_neighbours[arc.to]++;
+            level[arc.to] = std::max(level[arc.to], level[v] + 1);
+        }
+        for (HierarchyArc const& arc : out[v]) {
+            std::vector<HierarchyArc>& arcs = in[arc.to];
+            arcs.erase(std::remove_if(arcs.begin(), arcs.end(), [v](HierarchyArc const& a) { return a.to == v; }), arcs.end());
+            contracted_neighbours[arc.to]++;
+            level[arc.to] = std::max(level[arc.to], level[v] + 1);
+        }
+        std::vector<HierarchyArc>().swap(out[v]);
+        std::vector<HierarchyArc>().swap(in[v]);
+    }
+
+    ch->up_offsets.assign(n + 1, 0);
+    ch->down_offsets.assign(n + 1, 0);
+    for (std::uint32_t v = 0; v < n; v++) {
+        ch->up_offsets[v + 1] = ch->up_offsets[v] + up[v].size();
+        ch->down_offsets[v + 1] = ch->down_offsets[v] + down[v].size();
+        ch->up.insert(ch->up.end(), up[v].begin(), up[v].end());
+        ch->down.insert(ch->down.end(), down[v].begin(), down[v].end());
+    }
+    return ch;
+}
+
+/**
+ * @brief Datastructures::shortest_distance_hierarchy finds the shortest route with Dijkstra-algorithm upwards in the
+ *        contraction hierarchy from both of the stations. The best station reached from both sides is where the
+ *        route turns down, and a side stops when its smallest key is at least the best route found.
+ * @param search the reset SearchContext of the search
+ * @param ch the up-to-date ContractionHierarchy
+ * @param graph the up-to-date Graph
+ * @param s dense index of the start station
+ * @param g dense index of the end station
+ * @return the route like route_shortest_distance returns it
+ */
+std::vector<std::pair<StationID, Distance>> Datastructures::shortest_distance_hierarchy(SearchContext& search, ContractionHierarchy const& ch,
+                                                                                        Graph const& graph, std::uint32_t s,
+                                                                                        std::uint32_t g) const {
+    QuaternaryHeap<Distance, std::uint32_t>& forward = search.distance_queue;
+    QuaternaryHeap<Distance, std::uint32_t>& backward = search.reverse_distance_queue;
+    search.label(s).d = 0;
+    search.label(s).color = 1;
+    search.reverse_label(g).d = 0;
+    search.reverse_label(g).color = 1;
+    forward.push(0, s);
+    backward.push(0, g);
+    search.counters.push(false);
+    search.counters.push(false);
+
+    Distance best = std::numeric_limits<Distance>::max();
+    std::uint32_t meet = NO_INDEX;
+    while (true) {
+        if (!forward.empty() && forward.top().first >= best) {
+            forward.clear();
+        }
+        if (!backward.empty() && backward.top().first >= best) {
+            backward.clear();
+        }
+        if (forward.empty() && backward.empty()) {
+            break;
+        }
+        bool go_forward = backward.empty() || (!forward.empty() && forward.top().first <= backward.top().first);
+        QuaternaryHeap<Distance, std::uint32_t>& queue = go_forward ? forward : backward;
+        std::uint32_t u = queue.pop().second;
+        Label& lu = go_forward ? search.label(u) : search.reverse_label(u);
+        if (lu.color == 2) {
+            continue;
+        }
+        lu.color = 2;
+        search.counters.settle();
+        Label const& other = go_forward ? search.reverse_label(u) : search.label(u);
+        if (other.color != 0 && lu.d + other.d < best) {
+            best = lu.d + other.d;
+            meet = u;
+        }
+        std::vector<std::uint32_t> const& offsets = go_forward ? ch.up_offsets : ch.down_offsets;
+        std::vector<HierarchyArc> const& arcs = go_forward ? ch.up : ch.down;
+        for (std::uint32_t a = offsets[u]; a < offsets[u + 1]; a++) {
+            search.counters.relax();
+            Label& lv = go_forward ? search.label(arcs[a].to) : search.reverse_label(arcs[a].to);
+            if (lv.color != 2 && lv.d > lu.d + arcs[a].length) {
+                lv.d = lu.d + arcs[a].length;
+                lv.pi = u;
+                search.counters.push(lv.color == 1);
+                lv.color = 1;
+                queue.push(lv.d, arcs[a].to);
+            }
+        }
+    }
+    if (meet == NO_INDEX) {
+        return {};
+    }
+
+    std::vector<std::uint32_t> upward;
+    for (std::uint32_t i = meet; i != NO_INDEX; i = search.label(i).pi) {
+        upward.push_back(i);
+    }
+    std::reverse(upward.begin(), upward.end());
+    std::vector<std::uint32_t> hops = upward;
+    for (std::uint32_t i = search.reverse_label(meet).pi; i != NO_INDEX; i = search.reverse_label(i).pi) {
+        hops.push_back(i);
+    }
+    std::vector<std::uint32_t> route = {hops[0]};
+    for (std::size_t k = 0; k + 1 < hops.size(); k++) {
+        unpack_shortcut(ch, hops[k], hops[k + 1], route);
+    }
+    std::vector<std::pair<StationID, Distance>> result;
+    result.reserve(route.size());
+    Distance travelled = 0;
+    for (std::size_t k = 0; k < route.size(); k++) {
+        if (k > 0) {
+            travelled += distance_between_points(graph.coords[route[k - 1]], graph.coords[route[k]]);
+        }
+        result.push_back(std::make_pair(symbols.name(station_index[route[k]]->id), travelled));
+    }
+    return result;
+}
+
+/**
+ * @brief Datastructures::unpack_shortcut appends the stations of an arc of the hierarchy after its first station to
+ *        the route, replacing each shortcut with the two arcs it was made of
+ * @param ch the ContractionHierarchy
+ * @param from dense index of the station the arc leaves from
+ * @param to dense index of the station the arc arrives at
+ * @param route the stations of the route so far, which ends at from
+ */
+void Datastructures::unpack_shortcut(ContractionHierarchy const& ch, std::uint32_t from, std::uint32_t to, std::vector<std::uint32_t>& route) {
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> stack = {{from, to}};
+    while (!stack.empty()) {
+        std::pair<std::uint32_t, std::uint32_t> arc = stack.back();
+        stack.pop_back();
+        std::unordered_map<std::uint64_t, std::uint32_t>::const_iterator it = ch.shortcuts.find((std::uint64_t)arc.first << 32 | arc.second);
+        if (it == ch.shortcuts.end()) {
+            route.push_back(arc.second);
+        } else {
+            stack.push_back({it->second, arc.second});
+            stack.push_back({arc.first, it->second});
+        }
+    }
+}
+
+/**
+ * @brief Datastructures::worker_pool returns the pool of distance_matrix and route_queries and starts its threads
+ *        on the first call, one worker for every hardware thread, unless the pool was shared by publish
+ * @return a reference to the pool
+ */
+WorkStealingPool& Datastructures::worker_pool() const {
+    std::call_once(workers_started, [this]() {
+        if (!workers) {
+            workers = std::make_shared<WorkStealingPool>(std::max(1u, std::thread::hardware_concurrency()));
+        }
+    });
+    return *workers;
+}
+
+/**
+ * @brief Datastructures::distances_from runs the Dijkstra-algorithm from a station over the distances of the graph
+ *        until all of the target stations have been closed. The closed stations have color 2 and their distance in d.
+ * @param search the reset SearchContext of the search
+ * @param graph the up-to-date Graph
+ * @param s dense index of the station to start from
+ * @param is_target nonzero at the dense indexes of the target stations
+ * @param targets the number of different target stations
+ */
+void Datastructures::distances_from(SearchContext& search, Graph const& graph, std::uint32_t s, std::vector<char> const& is_target,
+                                    std::size_t targets) const {
+    TargetsPolicy policy{is_target, targets};
+    search_graph(search, graph, s, policy);
+}
+
+/**
+ * @brief Datastructures::relax_dijkstra Relax-function for the dijkstra-algorithm used in the route_earliest_arrival-method,
  *        which updates the both d-values if it finds a faster route
- * @param u a Station-pointer to the station coming from
- * @param v a Station-pointer to the station to go to
- * @param u_depart a Time-value of the departure time from station u
- * @param at_v a Time-value of the arrival time to station v
+ * @param search the SearchContext of the search
+ * @param u dense index of the station coming from
+ * @param e the Edge from u to the station to go to, which has the departure time from u and the arrival time to the other station
+ */
+void Datastructures::relax_dijkstra(SearchContext& search, std::uint32_t u, Edge const& e) {
+    Label& lu = search.label(u);
+    Label& lv = search.label(e.to);
+    if (lv.d > e.arrival && lu.d < e.arrival && lu.d <= e.departure && e.departure < e.arrival) {
+        lu.d = e.departure;
+        lv.d = e.arrival;
+        lv.pi = u;
+    }
+}
+
+/**
+ * @brief Datastructures::insert_departure adds a departure to the sorted departures of a station
+ *        if it doesn't already exist
+ * @param station the Station where the departure is to be added
+ * @param trainid symbol of the TrainID of the departing train
+ * @param time Time of the departure
+ * @return true if the departure didn't exist already and it was added, otherwise false
+ */
+bool Datastructures::insert_departure(Station& station, SymbolTable::Symbol trainid, Time time) {
+    Departures& departures = station.departures;
+    std::pair<Time, SymbolTable::Symbol> departure(time, trainid);
+    Departures::const_iterator it = find_departure(departures, time, trainid);
+
+    if (it != departures.end() && *it == departure) {
+        return false;
+    }
+    departures.insert(it, departure);
+    return true;
+}
+
+/**
+ * @brief Datastructures::find_departure finds the position of a departure in the sorted departures of a station
+ *        with std::lower_bound
+ * @param departures the departures sorted by the time and the TrainID
+ * @param time Time of the departure
+ * @param trainid symbol of the TrainID of the departing train
+ * @return a const_iterator to the departure or to the position where it would be inserted
+ */
+Datastructures::Departures::const_iterator Datastructures::find_departure(
+    Departures const& departures, Time time, SymbolTable::Symbol trainid) const {
+    return std::lower_bound(departures.begin(), departures.end(), std::make_pair(time, trainid),
+                            [this](std::pair<Time, SymbolTable::Symbol> a, std::pair<Time, SymbolTable::Symbol> b) {
+                                return departure_less(a, b);
+                            });
+}
+
+/**
+ * @brief Datastructures::departure_less is the order of the departures of a station: by the time and then
+ *        by the TrainID. Equal symbols are equal TrainIDs, so the strings are compared only if the train differs.
+ * @param a the first departure
+ * @param b the second departure
+ * @return true if a is before b, otherwise false
+ */
+bool Datastructures::departure_less(std::pair<Time, SymbolTable::Symbol> a, std::pair<Time, SymbolTable::Symbol> b) const {
+    if (a.first != b.first) return a.first < b.first;
+    return a.second != b.second && symbols.name(a.second) < symbols.name(b.second);
+}
+
+/**
+ * @brief Datastructures::find_stops looks up the stations of the given stationtimes
+ * @param stationtimes a vector of pairs of the stations of a train and the departure times from them
+ * @param stops the vector, where the Station-pointers are stored in the same order
+ * @return true if all of the stations were found, otherwise false
+ */
+bool Datastructures::find_stops(std::vector<std::pair<StationID, Time>> const& stationtimes, std::vector<Station*>& stops) {
+    stops.clear();
+    stops.reserve(stationtimes.size());
+    for (auto it = stationtimes.begin(); it != stationtimes.end(); it++) {
+        StationMap::iterator it2 = find_station(it->first);
+        if (it2 == stations.end()) {
+            return false;
+        }
+        stops.push_back(&it2->second);
+    }
+    return true;
+}
+
+/**
+ * @brief Datastructures::link_train adds a train to the trains of the stations it stops at and the next stops
+ *        of the train to the next stations of them
+ * @param train the Train, which has its stops looked up already
+ */
+void Datastructures::link_train(Train const& train) {
+    std::pmr::vector<Station*> const& stops = train.stops;
+    for (std::size_t k = 0; k < stops.size(); k++) {
+        stops[k]->train_stops.insert({&train, k});
+        if (k + 1 < stops.size()) {
+            std::pmr::vector<std::pair<Station*, unsigned int>>& next_stations = stops[k]->next_stations;
+            Station* next = stops[k + 1];
+            std::pmr::vector<std::pair<Station*, unsigned int>>::iterator it = std::find_if(
+                next_stations.begin(), next_stations.end(), [next](std::pair<Station*, unsigned int> const& p) { return p.first == next; });
+            if (it == next_stations.end()) {
+                next_stations.push_back({next, 1});
+            } else {
+                it->second++;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Datastructures::unlink_train removes a train from the trains of the stations it stops at and its next
+ *        stops from the next stations of them, undoing link_train
+ * @param train the Train, whose stops are the same as when it was linked
+ */
+void Datastructures::unlink_train(Train const& train) {
+    std::pmr::vector<Station*> const& stops = train.stops;
+    for (std::size_t k = 0; k < stops.size(); k++) {
+        stops[k]->train_stops.erase(&train);
+        if (k + 1 < stops.size()) {
+            std::pmr::vector<std::pair<Station*, unsigned int>>& next_stations = stops[k]->next_stations;
+            Station* next = stops[k + 1];
+            std::pmr::vector<std::pair<Station*, unsigned int>>::iterator it = std::find_if(
+                next_stations.begin(), next_stations.end(), [next](std::pair<Station*, unsigned int> const& p) { return p.first == next; });
+            if (it != next_stations.end() && --it->second == 0) {
+                next_stations.erase(it);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Datastructures::remove_train_departures removes the departures of a train from the stations it departs from
+ * @param train the Train, whose stops and times are the same as when its departures were added
+ */
+void Datastructures::remove_train_departures(Train const& train) {
+    for (std::size_t k = 0; k + 1 < train.stops.size(); k++) {
+        Departures& departures = train.stops[k]->departures;
+        Departures::const_iterator it = find_departure(departures, train.times[k], train.id);
+        if (it != departures.end() && *it == std::make_pair(train.times[k], train.id)) {
+            departures.erase(it);
+        }
+    }
+}
+
+/**
+ * @brief Datastructures::retime_graph updates the connections of a train in the station graph to its new times,
+ *        if the graph is up to date. Every connection is found with binary search from the edges of its station and
+ *        from the connection array and moved to its place by the new times, and the times of its reverse edge are
+ *        changed. The stops and so the lengths stay the same, so the graph keeps its version and the contraction
+ *        hierarchy stays valid.
+ * @param train the Train with its new times
+ * @param old_times the times of the train, which are in the graph
+ */
+void Datastructures::retime_graph(Train const& train, std::pmr::vector<Time> const& old_times) {
+    std::lock_guard<std::mutex> lock(graph_mutex);
+    if (graph_dirty.load(std::memory_order_relaxed)) {
+        return;
+    }
+    auto edge_less = [](Edge const& a, Edge const& b) {
+        if (a.departure != b.departure) return a.departure < b.departure;
+        if (a.arrival != b.arrival) return a.arrival < b.arrival;
+        return a.to < b.to;
+    };
+    auto connection_less = [](Connection const& a, Connection const& b) {
+        if (a.departure != b.departure) return a.departure < b.departure;
+        return a.arrival < b.arrival;
+    };
+    for (std::size_t k = 0; k + 1 < train.stops.size(); k++) {
+        std::uint32_t from = train.stops[k]->index;
+        std::uint32_t to = train.stops[k + 1]->index;
+        Time departure = train.times[k];
+        Time arrival = train.times[k + 1];
+
+        std::vector<Edge>::iterator first = graph.edges.begin() + graph.offsets[from];
+        std::vector<Edge>::iterator last = graph.edges.begin() + graph.offsets[from + 1];
+        Edge edge = {old_times[k], old_times[k + 1], to, 0};
+        std::vector<Edge>::iterator e = std::lower_bound(first, last, edge, edge_less);
+        std::vector<Connection>::iterator c = std::lower_bound(graph.connections.begin(), graph.connections.end(),
+                                                               Connection{edge.departure, edge.arrival, from, to}, connection_less);
+        while (c != graph.connections.end() && c->departure == edge.departure && c->arrival == edge.arrival && (c->from != from || c->to != to)) {
+            c++;
+        }
+        if (e == last || e->departure != edge.departure || e->arrival != edge.arrival || e->to != to || c == graph.connections.end() ||
+            c->departure != edge.departure || c->arrival != edge.arrival) {
+            graph_dirty = true;
+            return;
+        }
+        edge = *e;
+        edge.departure = departure;
+        edge.arrival = arrival;
+        if (edge_less(edge, *e)) {
+            std::vector<Edge>::iterator place = std::upper_bound(first, e, edge, edge_less);
+            std::rotate(place, e, e + 1);
+            *place = edge;
+        } else {
+            std::vector<Edge>::iterator place = std::lower_bound(e + 1, last, edge, edge_less);
+            std::rotate(e, e + 1, place);
+            *(place - 1) = edge;
+        }
+        Connection connection = {departure, arrival, from, to};
+        if (connection_less(connection, *c)) {
+            std::vector<Connection>::iterator place = std::upper_bound(graph.connections.begin(), c, connection, connection_less);
+            std::rotate(place, c, c + 1);
+            *place = connection;
+        } else {
+            std::vector<Connection>::iterator place = std::lower_bound(c + 1, graph.connections.end(), connection, connection_less);
+            std::rotate(c, c + 1, place);
+            *(place - 1) = connection;
+        }
+        for (std::uint32_t r = graph.reverse_offsets[to]; r < graph.reverse_offsets[to + 1]; r++) {
+            Edge& reverse = graph.reverse_edges[r];
+            if (reverse.to == from && reverse.departure == old_times[k] && reverse.arrival == old_times[k + 1]) {
+                reverse.departure = departure;
+                reverse.arrival = arrival;
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Datastructures::append_snapshot_section appends a section of a snapshot to the image and pads the image
+ *        to a multiple of 8 bytes, so every section of the mapped file is aligned for its records
+ * @param image the snapshot built so far
+ * @param data the records of the section
+ * @param bytes the size of the records in bytes
+ */
+void Datastructures::append_snapshot_section(std::vector<char>& image, void const* data, std::size_t bytes) {
+    char const* begin = static_cast<char const*>(data);
+    image.insert(image.end(), begin, begin + bytes);
+    image.resize((image.size() + 7) / 8 * 8, 0);
+}
+
+/**
+ * @brief Datastructures::load_snapshot_image loads a snapshot from memory. Checks the header and that every section
+ *        and every index and string is inside the image before clearing the old data. The rest, like duplicate
+ *        IDs and missing regions, is noticed only while loading.
+ * @param image the snapshot, aligned to 8 bytes
+ * @param size the size of the snapshot in bytes
+ * @return true if the snapshot was loaded, otherwise false
+ */
+bool Datastructures::load_snapshot_image(char const* image, std::size_t size) {
+    static_assert(sizeof(SnapshotHeader) % 8 == 0 && sizeof(SnapshotStation) == 40 && sizeof(SnapshotRegion) == 40,
+                  "Snapshot records must not depend on the compiler");
+    static_assert(sizeof(Edge) == 12 && sizeof(Connection) == 12, "Graph records must not have padding");
+    SnapshotHeader header;
+    std::memcpy(&header, image, sizeof(header));
+    if (std::memcmp(header.magic, "DSSNAP\0\0", sizeof(header.magic)) != 0 || header.version != SNAPSHOT_VERSION ||
+        header.byte_order != SNAPSHOT_BYTE_ORDER || header.symbols >= SymbolTable::NO_SYMBOL || header.stations >= NO_INDEX) {
+        return false;
+    }
+
+    std::size_t offset = sizeof(header);
+    bool fits = true;
+    auto section = [image, size, &offset, &fits](std::uint64_t count, std::size_t record) {
+        if (count > (size - offset) / record) {
+            fits = false;
+            return image;
+        }
+        char const* begin = image + offset;
+        offset = std::min<std::size_t>(size, (offset + count * record + 7) / 8 * 8);
+        return begin;
+    };
+    SnapshotString const* symbol_strings = reinterpret_cast<SnapshotString const*>(section(header.symbols, sizeof(SnapshotString)));
+    SnapshotStation const* station_records = reinterpret_cast<SnapshotStation const*>(section(header.stations, sizeof(SnapshotStation)));
+    SnapshotDeparture const* departure_records =
+        reinterpret_cast<SnapshotDeparture const*>(section(header.departures, sizeof(SnapshotDeparture)));
+    SnapshotRegion const* region_records = reinterpret_cast<SnapshotRegion const*>(section(header.regions, sizeof(SnapshotRegion)));
+    Coord const* region_coords = reinterpret_cast<Coord const*>(section(header.region_coords, sizeof(Coord)));
+    SnapshotTrain const* train_records = reinterpret_cast<SnapshotTrain const*>(section(header.trains, sizeof(SnapshotTrain)));
+    SnapshotStop const* stop_records = reinterpret_cast<SnapshotStop const*>(section(header.stops, sizeof(SnapshotStop)));
+    std::uint32_t const* offsets = reinterpret_cast<std::uint32_t const*>(section(header.stations + 1, sizeof(std::uint32_t)));
+    Edge const* edges = reinterpret_cast<Edge const*>(section(header.edges, sizeof(Edge)));
+    Connection const* connections = reinterpret_cast<Connection const*>(section(header.edges, sizeof(Connection)));
+    char const* strings = section(header.string_bytes, 1);
+    if (!fits) {
+        return false;
+    }
+
+    auto valid_string = [&header](SnapshotString s) {
+        return s.offset <= header.string_bytes && s.length <= header.string_bytes - s.offset;
+    };
+    auto view = [strings](SnapshotString s) { return std::string_view(strings + s.offset, s.length); };
+    for (std::uint64_t i = 0; i < header.symbols; i++) {
+        fits = fits && valid_string(symbol_strings[i]);
+    }
+    std::uint64_t departure_count = 0;
+    for (std::uint64_t i = 0; i < header.stations; i++) {
+        fits = fits && station_records[i].id < header.symbols && valid_string(station_records[i].name);
+        departure_count += station_records[i].departures;
+    }
+    for (std::uint64_t i = 0; i < header.departures; i++) {
+        fits = fits && departure_records[i].train < header.symbols;
+    }
+    std::uint64_t coord_count = 0;
+    for (std::uint64_t i = 0; i < header.regions; i++) {
+        fits = fits && valid_string(region_records[i].name) && region_records[i].coords <= header.region_coords;
+        coord_count += region_records[i].coords;
+    }
+    std::uint64_t stop_count = 0;
+    for (std::uint64_t i = 0; i < header.trains; i++) {
+        fits = fits && train_records[i].id < header.symbols;
+        stop_count += train_records[i].stops;
+    }
+    for (std::uint64_t i = 0; i < header.stops; i++) {
+        fits = fits && stop_records[i].station < header.stations;
+    }
+    fits = fits && departure_count == header.departures && coord_count == header.region_coords && stop_count == header.stops;
+    fits = fits && offsets[0] == 0 && offsets[header.stations] == header.edges;
+    for (std::uint64_t i = 0; i < header.stations; i++) {
+        fits = fits && offsets[i] <= offsets[i + 1];
+    }
+    for (std::uint64_t e = 0; e < header.edges; e++) {
+        fits = fits && edges[e].to < header.stations && connections[e].from < header.stations && connections[e].to < header.stations;
+    }
+    if (!fits) {
+        return false;
+    }
+
+    clear_data();
+    bool consistent = true;
+    for (SymbolTable::Symbol i = 0; i < header.symbols; i++) {
+        consistent = consistent && symbols.intern(view(symbol_strings[i])) == i;
+    }
+
+    stations.reserve(header.stations);
+    station_index.reserve(header.stations);
+    SnapshotDeparture const* departure = departure_records;
+    for (std::uint64_t i = 0; i < header.stations; i++) {
+        SnapshotStation const& record = station_records[i];
+        std::pair<StationMap::iterator, bool> inserted = stations.try_emplace(record.id);
+        consistent = consistent && inserted.second;
+        Station* station = &inserted.first->second;
+        station->id = record.id;
+        station->name = view(record.name);
+        station->location = record.location;
+        station->region = record.region;
+        station->index = station_index.size();
+        station->departures.reserve(station->departures.size() + record.departures);
+        for (std::uint32_t k = 0; k < record.departures; k++, departure++) {
+            station->departures.push_back({departure->time, departure->train});
+        }
+        station_index.push_back(station);
+    }
+
+    regions.reserve(header.regions);
+    Coord const* coords = region_coords;
+    for (std::uint64_t i = 0; i < header.regions; i++) {
+        SnapshotRegion const& record = region_records[i];
+        consistent = consistent && insert_region(record.id, Name(view(record.name)), std::vector<Coord>(coords, coords + record.coords));
+        coords += record.coords;
+    }
+    for (std::uint64_t i = 0; i < header.regions; i++) {
+        SnapshotRegion const& record = region_records[i];
+        if (record.parent != NO_REGION) {
+            RegionMap::iterator region = regions.find(record.id);
+            RegionMap::iterator parent = regions.find(record.parent);
+            consistent = consistent && region != regions.end() && parent != regions.end();
+            if (region != regions.end() && parent != regions.end()) {
+                region->second.parent = record.parent;
+                parent->second.subregions.insert(record.id);
+            }
+        }
+    }
+    for (Station const* station : station_index) {
+        consistent = consistent && (station->region == NO_REGION || regions.count(station->region) != 0);
+    }
+
+    trains.reserve(header.trains);
+    SnapshotStop const* stop = stop_records;
+    for (std::uint64_t i = 0; i < header.trains; i++) {
+        SnapshotTrain const& record = train_records[i];
+        std::pair<TrainMap::iterator, bool> inserted = trains.try_emplace(record.id);
+        consistent = consistent && inserted.second;
+        Train& train = inserted.first->second;
+        train.id = record.id;
+        train.stops.reserve(record.stops);
+        train.times.reserve(record.stops);
+        for (std::uint32_t k = 0; k < record.stops; k++, stop++) {
+            train.stops.push_back(station_index[stop->station]);
+            train.times.push_back(stop->time);
+        }
+        if (inserted.second) {
+            link_train(train);
+        }
+    }
+    if (!consistent) {
+        clear_data();
+        return false;
+    }
+
+    if (stations.size() >= grid_rebuild_at) {
+        rebuild_station_grid();
+    } else {
+        for (Station* station : station_index) {
+            index_station(station);
+        }
+    }
+    stations_by_name_dirty = true;
+    stations_by_distance_dirty = true;
+    std::lock_guard<std::mutex> lock(graph_mutex);
+    graph.coords.resize(header.stations);
+    for (std::size_t i = 0; i < header.stations; i++) {
+        graph.coords[i] = station_index[i]->location;
+    }
+    graph.offsets.assign(offsets, offsets + header.stations + 1);
+    graph.edges.assign(edges, edges + header.edges);
+    graph.connections.assign(connections, connections + header.edges);
+    build_reverse_edges(graph);
+    graph_version++;
+    graph_dirty.store(false, std::memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Datastructures::current_graph returns the compressed sparse row adjacency of the stations and rebuilds it
+ *        from the trains first if it has been marked dirty. Counts the edges of every station first, so the edges can
+ *        be placed directly to their rows, and then sorts every row by the departure times. Also builds the
+ *        connections sorted by the departure times for the connection scan. Concurrent readers wait
+ *        for the one building the graph.
+ * @return a reference to the up-to-date Graph
+ */
+Datastructures::Graph const& Datastructures::current_graph() const {
+    if (!graph_dirty.load(std::memory_order_acquire)) {
+        return graph;
+    }
+    std::lock_guard<std::mutex> lock(graph_mutex);
+    if (!graph_dirty.load(std::memory_order_relaxed)) {
+        return graph;
+    }
+    std::size_t n = station_index.size();
+    graph.coords.resize(n);
+    for (std::size_t i = 0; i < n; i++) {
+        graph.coords[i] = station_index[i]->location;
+    }
+    graph.offsets.assign(n + 1, 0);
+    for (TrainMap::const_iterator it = trains.begin(); it != trains.end(); it++) {
+        std::pmr::vector<Station*> const& stops = it->second.stops;
+        for (std::size_t k = 0; k + 1 < stops.size(); k++) {
+            graph.offsets[stops[k]->index + 1]++;
+        }
+    }
+    for (std::size_t i = 0; i < n; i++) {
+        graph.offsets[i + 1] += graph.offsets[i];
+    }
+    graph.edges.resize(graph.offsets[n]);
+    std::vector<std::uint32_t> next_free(graph.offsets.begin(), graph.offsets.end() - 1);
+    for (TrainMap::const_iterator it = trains.begin(); it != trains.end(); it++) {
+        std::pmr::vector<Time> const& times = it->second.times;
+        std::pmr::vector<Station*> const& stops = it->second.stops;
+        for (std::size_t k = 0; k + 1 < stops.size(); k++) {
+            std::uint32_t from = stops[k]->index;
+            std::uint32_t to = stops[k + 1]->index;
+            graph.edges[next_free[from]++] = {times[k], times[k + 1], to,
+                                              distance_between_points(graph.coords[from], graph.coords[to])};
+        }
+    }
+    for (std::size_t i = 0; i < n; i++) {
+        std::sort(graph.edges.begin() + graph.offsets[i], graph.edges.begin() + graph.offsets[i + 1], [](Edge const& a, Edge const& b) {
+            if (a.departure != b.departure) return a.departure < b.departure;
+            if (a.arrival != b.arrival) return a.arrival < b.arrival;
+            return a.to < b.to;
+        });
+    }
+    graph.connections.clear();
+    graph.connections.reserve(graph.edges.size());
+    for (std::uint32_t i = 0; i < n; i++) {
+        for (std::uint32_t e = graph.offsets[i]; e < graph.offsets[i + 1]; e++) {
+            graph.connections.push_back({graph.edges[e].departure, graph.edges[e].arrival, i, graph.edges[e].to});
+        }
+    }
+    std::sort(graph.connections.begin(), graph.connections.end(), [](Connection const& a, Connection const& b) {
+        if (a.departure != b.departure) return a.departure < b.departure;
+        return a.arrival < b.arrival;
+    });
+    build_reverse_edges(graph);
+    graph_version++;
+    graph_dirty.store(false, std::memory_order_release);
+    return graph;
+}
+
+/**
+ * @brief Datastructures::SearchContext::reset prepares the context for a new search over n stations. Grows the
+ *        label array if needed and starts a new generation, which makes all of the old labels outdated, so the
+ *        reset doesn't depend on the number of stations. The labels are cleared only when the generation wraps around.
+ * @param n the number of stations to be searched
+ */
+void Datastructures::SearchContext::reset(std::size_t n) {
+    if (labels.size() < n) {
+        labels.resize(n);
+        reverse_labels.resize(n);
+        profiles.resize(n);
+    }
+    generation++;
+    if (generation == 0) {
+        std::fill(labels.begin(), labels.end(), Label{});
+        std::fill(reverse_labels.begin(), reverse_labels.end(), Label{});
+        generation = 1;
+        counters.sweep(labels.size() + reverse_labels.size());
+    }
+    counters.start();
+    frontier.clear();
+    station_queue.clear();
+    distance_queue.clear();
+    reverse_frontier.clear();
+    reverse_distance_queue.clear();
+    time_queue.clear();
+    transfer_steps.clear();
+}
+
+/**
+ * @brief Datastructures::SearchContext::profile returns the journeys of a station in the profile search and
+ *        clears the ones left from an earlier search first
+ * @param i dense index of the station
+ * @return a reference to the journeys of the station
+ */
+std::vector<Datastructures::ProfileEntry>& Datastructures::SearchContext::profile(std::uint32_t i) {
+    Label& l = label(i);
+    if (l.color == 0) {
+        l.color = 1;
+        profiles[i].clear();
+    }
+    return profiles[i];
+}
+
+/**
+ * @brief Datastructures::PooledSearch::PooledSearch takes a SearchContext from the pool of the given Datastructures
+ *        or creates a new one if the pool is empty, and resets it for a search over all of the stations. The slots
+ *        are only read before the exchange, so the empty ones aren't written to.
+ * @param owner the Datastructures, whose pool is used
+ */
+Datastructures::PooledSearch::PooledSearch(Datastructures const& owner) : owner_(owner) {
+    for (std::atomic<SearchContext*>& slot : owner_.search_pool) {
+        if (slot.load(std::memory_order_relaxed) != nullptr) {
+            context_.reset(slot.exchange(nullptr, std::memory_order_acquire));
+            if (context_) {
+                break;
+            }
+        }
+    }
+    if (!context_) {
+        context_ = std::make_unique<SearchContext>();
+    }
+    context_->reset(owner_.station_index.size());
+}
+
+/**
+ * @brief Datastructures::PooledSearch::~PooledSearch returns the SearchContext to the pool, so its memory
+ *        can be reused by the next search, and adds the counters of its searches to the stats of the owner.
+ *        The context is deleted if every slot of the pool is full.
+ */
+Datastructures::PooledSearch::~PooledSearch() {
+#if DATASTRUCTURES_STATS
+    SearchTotals& total = owner_.search_stats;
+    SearchStats const& counted = context_->counters.stats;
+    total.searches.fetch_add(counted.searches, std::memory_order_relaxed);
+    total.settled.fetch_add(counted.settled, std::memory_order_relaxed);
+    total.relaxed.fetch_add(counted.relaxed, std::memory_order_relaxed);
+    total.pushes.fetch_add(counted.pushes, std::memory_order_relaxed);
+    total.decrease_keys.fetch_add(counted.decrease_keys, std::memory_order_relaxed);
+    total.labels_reset.fetch_add(counted.labels_reset, std::memory_order_relaxed);
+    total.reset_sweeps.fetch_add(counted.reset_sweeps, std::memory_order_relaxed);
+    context_->counters.stats = SearchStats{};
+#endif
+    for (std::atomic<SearchContext*>& slot : owner_.search_pool) {
+        SearchContext* empty = nullptr;
+        if (slot.load(std::memory_order_relaxed) == nullptr &&
+            slot.compare_exchange_strong(empty, context_.get(), std::memory_order_release, std::memory_order_relaxed)) {
+            context_.release();
+            return;
+        }
+    }
+}
+
+#if DATASTRUCTURES_STATS
+/**
+ * @brief Datastructures::OperationTimer::OperationTimer starts timing a call of an operation
+ * @param owner the Datastructures, whose stats count the call
+ * @param operation the operation called
+ */
+Datastructures::OperationTimer::OperationTimer(Datastructures const& owner, StatsOperation operation)
+    : owner_(owner), operation_(operation), start_(std::chrono::steady_clock::now()) {}
+
+/**
+ * @brief Datastructures::OperationTimer::~OperationTimer counts the call and its latency to the bucket of the
+ *        highest bit of the latency in microseconds
  */
-void Datastructures::relax_dijkstra(Station* u, Station* v, Time& u_depart, Time& at_v) {
-    if (v->d > at_v && u->d < at_v && u->d <= u_depart && u_depart < at_v) {
-        u->d = u_depart;
-        v->d = at_v;
-        v->pi = u;
+Datastructures::OperationTimer::~OperationTimer() {
+    unsigned long long nanoseconds =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+    std::size_t bucket = 0;
+    for (unsigned long long microseconds = nanoseconds / 1000; microseconds != 0 && bucket + 1 < OperationStats::LATENCY_BUCKETS;
+         microseconds >>= 1) {
+        bucket++;
     }
+    OperationCounters& counters = owner_.operation_stats[(std::size_t)operation_];
+    counters.calls.fetch_add(1, std::memory_order_relaxed);
+    counters.total_nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    counters.latency[bucket].fetch_add(1, std::memory_order_relaxed);
 }
+#endif
@@ -1,14 +1,26 @@
 #ifndef DATASTRUCTURES_HH
 #define DATASTRUCTURES_HH
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <exception>
 #include <functional>
 #include <limits>
 #include <list>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <queue>
 #include <set>
 #include <stack>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <tuple>
 #include <unordered_map>
 #include <unordered_set>
@@ -74,6 +86,168 @@ using Distance = int;
 // Return value for cases where Distance is unknown
 Distance const NO_DISTANCE = NO_VALUE;
 
+// Search algorithm used by route_earliest_arrival
+enum class TimetableEngine {
+    // Dijkstra-algorithm over the station graph, the default
+    dijkstra,
+    // Connection scan over all of the train connections sorted by departure time, selected with
+    // set_timetable_engine
+    connection_scan
+};
+
+// Search direction used by route_least_stations and route_shortest_distance
+enum class SearchDirection {
+    // Breadth-first search and A-star-algorithm from the start station
+    forward,
+    // Breadth-first search and Dijkstra-algorithm from both of the stations, backwards over the incoming
+    // connections from the end station, until the searches meet
+    bidirectional
+};
+
+// Route searches, which can be done in a batch with route_queries
+enum class RouteQueryKind { least_stations, shortest_distance, earliest_arrival };
+
+// A route search of a batch. starttime is used only by RouteQueryKind::earliest_arrival.
+struct RouteQuery {
+    RouteQueryKind kind = RouteQueryKind::shortest_distance;
+    StationID fromid = NO_STATION;
+    StationID toid = NO_STATION;
+    Time starttime = NO_TIME;
+};
+
+// The route of a RouteQuery as the route function of its kind returns it: in route for least_stations
+// and shortest_distance and in timed_route for earliest_arrival. The other one is left empty.
+struct RouteQueryResult {
+    std::vector<std::pair<StationID, Distance>> route;
+    std::vector<std::pair<StationID, Time>> timed_route;
+};
+
+// A journey of route_earliest_arrival_transfers: the stations and the departure times from them like in
+// route_earliest_arrival, the last one having the arrival time, and the trains taken in order
+struct TransferJourney {
+    std::vector<std::pair<StationID, Time>> route;
+    std::vector<TrainID> trains;
+};
+
+// Lookups of the result cache, which found a result from it and which had to compute the result. skipped counts
+// the lookups and inserts, which found the cache in use by another thread and went on without it.
+struct ResultCacheStats {
+    unsigned long long hits = 0;
+    unsigned long long misses = 0;
+    unsigned long long skipped = 0;
+};
+
+// Counting of Datastructures::stats() can be compiled out of the operations with -DDATASTRUCTURES_STATS=0,
+// in which case stats() returns only zeros
+#ifndef DATASTRUCTURES_STATS
+#define DATASTRUCTURES_STATS 1
+#endif
+
+// Operations, whose calls and latencies are counted by Datastructures::stats(). Every public operation of
+// Datastructures is counted, except the getters and setters of the settings, published() and the stats themselves.
+// The overloads of an operation are counted together.
+enum class StatsOperation {
+    station_count,
+    clear_all,
+    all_stations,
+    add_station,
+    add_stations,
+    get_station_name,
+    get_station_coordinates,
+    stations_alphabetically,
+    stations_distance_increasing,
+    find_station_with_coord,
+    change_station_coord,
+    add_departure,
+    remove_departure,
+    station_departures_after,
+    add_region,
+    all_regions,
+    get_region_name,
+    get_region_coords,
+    add_subregion_to_region,
+    add_station_to_region,
+    station_in_regions,
+    all_subregions_of_region,
+    count_subregions_of_region,
+    regions_containing,
+    stations_closest_to,
+    remove_station,
+    common_parent_of_regions,
+    add_train,
+    add_trains,
+    next_stations_from,
+    train_stations_from,
+    clear_trains,
+    remove_train,
+    update_train_times,
+    route_any,
+    route_least_stations,
+    route_with_cycle,
+    route_shortest_distance,
+    distance_matrix,
+    route_queries,
+    route_earliest_arrival,
+    route_earliest_arrival_profile,
+    route_earliest_arrival_transfers,
+    save_snapshot,
+    load_snapshot,
+    publish,
+    count
+};
+
+// Calls of one operation. latency[0] counts the calls, which took less than a microsecond, and latency[b] the
+// ones, which took from 2^(b-1) to 2^b microseconds. The last bucket counts all of the slower calls too.
+struct OperationStats {
+    static constexpr std::size_t LATENCY_BUCKETS = 32;
+    unsigned long long calls = 0;
+    unsigned long long total_nanoseconds = 0;
+    std::array<unsigned long long, LATENCY_BUCKETS> latency{};
+};
+
+// Work of all of the route searches added up. A search is every reset of a search context.
+struct SearchStats {
+    unsigned long long searches = 0;
+    // Stations closed by Dijkstra- or A-star-algorithm or expanded by a breadth- or depth-first search
+    unsigned long long settled = 0;
+    // Edges, arcs of the contraction hierarchy, connections and stops of the routes of route_earliest_arrival_transfers scanned
+    unsigned long long relaxed = 0;
+    // Entries added to the queues and the frontiers
+    unsigned long long pushes = 0;
+    // Pushes of a station already in the queue with a smaller key, which replace a decrease-key
+    unsigned long long decrease_keys = 0;
+    // Labels of the stations cleared for a new search, one at a time when first used by the search or all at once
+    // by a sweep when the generation wraps around
+    unsigned long long labels_reset = 0;
+    unsigned long long reset_sweeps = 0;
+};
+
+// Snapshot of the counters of a Datastructures, operations indexed by StatsOperation
+struct DatastructuresStats {
+    std::array<OperationStats, (std::size_t)StatsOperation::count> operations;
+    SearchStats search;
+};
+
+// Squared distance between two coordinates in 64-bit integer arithmetic. Comparing
+// squared distances gives the same order as comparing the distances, without any
+// floating point math. Exact whenever the result fits in a long long.
+inline long long squared_distance(Coord a, Coord b) {
+    long long dx = (long long)a.x - b.x;
+    long long dy = (long long)a.y - b.y;
+    unsigned long long ux = dx < 0 ? -dx : dx;
+    unsigned long long uy = dy < 0 ? -dy : dy;
+    return (long long)(ux * ux + uy * uy);
+}
+
+// True if a is strictly closer to origin than b
+inline bool is_closer(Coord origin, Coord a, Coord b) {
+    return squared_distance(origin, a) < squared_distance(origin, b);
+}
+
+// Computes out[i] = squared_distance(origin, {xs[i], ys[i]}) for i < n. Uses AVX2 or NEON
+// when the compiler targets them (eg. -mavx2 or -march=native), otherwise a scalar loop.
+void squared_distances(Coord origin, int const* xs, int const* ys, std::size_t n, long long* out);
+
 // This exception class is there just so that the user interface can notify
 // about operations which are not (yet) implemented
 class NotImplemented : public std::exception {
@@ -89,6 +263,285 @@ class NotImplemented : public std::exception {
     std::string msg_;
 };
 
+// Min-priority queue of (key, value) pairs stored as an implicit 4-ary heap in a std::vector.
+// There is no decrease-key: the value is pushed again with the new key and the caller skips the
+// outdated entries when they are popped (lazy deletion). Clearing keeps the allocated memory.
+template <typename Key, typename Value>
+class QuaternaryHeap {
+   public:
+    bool empty() const { return heap_.empty(); }
+    std::size_t size() const { return heap_.size(); }
+    void clear() { heap_.clear(); }
+    void reserve(std::size_t n) { heap_.reserve(n); }
+    std::pair<Key, Value> const& top() const { return heap_.front(); }
+
+    void push(Key key, Value value) {
+        std::size_t i = heap_.size();
+        heap_.emplace_back(key, value);
+        while (i > 0) {
+            std::size_t parent = (i - 1) / 4;
+            if (!(heap_[i].first < heap_[parent].first)) {
+                break;
+            }
+            std::swap(heap_[i], heap_[parent]);
+            i = parent;
+        }
+    }
+
+    std::pair<Key, Value> pop() {
+        std::pair<Key, Value> top = heap_.front();
+        heap_.front() = heap_.back();
+        heap_.pop_back();
+        std::size_t i = 0;
+        while (true) {
+            std::size_t first_child = 4 * i + 1;
+            if (first_child >= heap_.size()) {
+                break;
+            }
+            std::size_t smallest = first_child;
+            std::size_t last_child = std::min(first_child + 4, heap_.size());
+            for (std::size_t c = first_child + 1; c < last_child; c++) {
+                if (heap_[c].first < heap_[smallest].first) {
+                    smallest = c;
+                }
+            }
+            if (!(heap_[smallest].first < heap_[i].first)) {
+                break;
+            }
+            std::swap(heap_[i], heap_[smallest]);
+            i = smallest;
+        }
+        return top;
+    }
+
+   private:
+    std::vector<std::pair<Key, Value>> heap_;
+};
+
+// Monotone min-priority queue for Time keys: a pushed key can't be smaller than the last
+// popped key, which holds for Dijkstra's algorithm. Entries are kept in 17 buckets by the highest
+// bit in which the key differs from the last popped key, so push is constant and pop is amortized
+// constant. Decrease-key works like in QuaternaryHeap, by pushing again (lazy deletion).
+template <typename Value>
+class RadixHeap {
+   public:
+    bool empty() const { return size_ == 0; }
+    std::size_t size() const { return size_; }
+
+    void clear() {
+        for (std::vector<std::pair<Time, Value>>& bucket : buckets_) {
+            bucket.clear();
+        }
+        size_ = 0;
+        last_ = 0;
+    }
+
+    void push(Time key, Value value) {
+        buckets_[bucket_of(key)].emplace_back(key, value);
+        size_++;
+    }
+
+    std::pair<Time, Value> pop() {
+        if (buckets_[0].empty()) {
+            std::size_t i = 1;
+            while (buckets_[i].empty()) {
+                i++;
+            }
+            last_ = buckets_[i].front().first;
+            for (std::pair<Time, Value> const& entry : buckets_[i]) {
+                last_ = std::min(last_, entry.first);
+            }
+            for (std::pair<Time, Value> const& entry : buckets_[i]) {
+                buckets_[bucket_of(entry.first)].push_back(entry);
+            }
+            buckets_[i].clear();
+        }
+        std::pair<Time, Value> top = buckets_[0].back();
+        buckets_[0].pop_back();
+        size_--;
+        return top;
+    }
+
+   private:
+    std::size_t bucket_of(Time key) const {
+        unsigned int diff = key ^ last_;
+        std::size_t bits = 0;
+        while (diff != 0) {
+            diff >>= 1;
+            bits++;
+        }
+        return bits;
+    }
+
+    std::vector<std::pair<Time, Value>> buckets_[std::numeric_limits<Time>::digits + 1];
+    std::size_t size_ = 0;
+    Time last_ = 0;
+};
+
+// First-in first-out queue with the interface of the heaps above for breadth-first searches. The keys aren't
+// kept, since the values are popped in the order they were pushed. Clearing keeps the allocated memory.
+template <typename Key, typename Value>
+class FifoQueue {
+   public:
+    bool empty() const { return head_ == values_.size(); }
+    std::size_t size() const { return values_.size() - head_; }
+    void clear() {
+        values_.clear();
+        head_ = 0;
+    }
+    void push(Key, Value value) { values_.push_back(value); }
+    std::pair<Key, Value> pop() { return {Key{}, values_[head_++]}; }
+
+   private:
+    std::vector<Value> values_;
+    std::size_t head_ = 0;
+};
+
+// Fixed set of threads running batches of tasks. The tasks of a batch are divided evenly to the queues
+// of the workers. Each worker takes tasks from the back of its own queue and, when it runs out, steals
+// from the front of the other queues, so uneven tasks keep all of the workers busy until the end.
+class WorkStealingPool {
+   public:
+    // The calling thread of run() is worker 0, so workers - 1 threads are started
+    explicit WorkStealingPool(std::size_t workers);
+    ~WorkStealingPool();
+    WorkStealingPool(WorkStealingPool const&) = delete;
+    WorkStealingPool& operator=(WorkStealingPool const&) = delete;
+
+    std::size_t size() const { return queues_.size(); }
+    // Calls task(worker, i) for every i < count and returns after all of the calls have returned.
+    // The threads run the batch of one thread at a time. A batch started meanwhile is run on its own thread
+    // alone as worker 0, so run() never waits for the batch of another thread.
+    void run(std::size_t count, std::function<void(std::size_t, std::size_t)> const& task);
+
+   private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::size_t> tasks;
+    };
+
+    bool take(std::size_t worker, std::size_t& task);
+    void work(std::size_t worker);
+    void thread_main(std::size_t worker);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::mutex run_mutex_;
+    std::mutex mutex_;
+    std::condition_variable started_;
+    std::condition_variable finished_;
+    std::function<void(std::size_t, std::size_t)> const* task_ = nullptr;
+    std::size_t batch_ = 0;
+    std::size_t busy_ = 0;
+    bool stopping_ = false;
+};
+
+// Bounded cache of results by string keys, which drops the least recently used result when full. Every lookup
+// and insert gives the epoch the result belongs to, and the cache is emptied when the epoch changes, so results
+// of older data are never returned. The entries are kept in a std::list from the most to the least recently
+// used, which never moves them, so the lookup map can use std::string_views of their keys. Can be used from
+// many threads at once. A lookup or insert, which finds the cache locked by another thread, skips the cache instead
+// of waiting, so the cache never blocks a query.
+template <typename Value>
+class LruCache {
+   public:
+    // Capacity 0 disables the cache
+    void set_capacity(std::size_t capacity) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        capacity_ = capacity;
+        while (entries_.size() > capacity) {
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+        }
+    }
+    std::size_t capacity() const { return capacity_.load(std::memory_order_relaxed); }
+    bool enabled() const { return capacity() != 0; }
+
+    // Copies the result of the key to value and makes it the most recently used one
+    bool find(std::string const& key, std::uint64_t epoch, Value& value) {
+        std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            skipped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        start_epoch(epoch);
+        typename std::unordered_map<std::string_view, typename std::list<Entry>::iterator>::iterator it = index_.find(key);
+        if (it == index_.end()) {
+            stats_.misses++;
+            return false;
+        }
+        entries_.splice(entries_.begin(), entries_, it->second);
+        value = it->second->second;
+        stats_.hits++;
+        return true;
+    }
+
+    void insert(std::string&& key, std::uint64_t epoch, Value const& value) {
+        std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            skipped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        start_epoch(epoch);
+        if (capacity_ == 0 || index_.count(key) != 0) {
+            return;
+        }
+        if (entries_.size() == capacity_) {
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+        }
+        entries_.emplace_front(std::move(key), value);
+        index_.emplace(entries_.front().first, entries_.begin());
+    }
+
+    ResultCacheStats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ResultCacheStats result = stats_;
+        result.skipped = skipped_.load(std::memory_order_relaxed);
+        return result;
+    }
+
+   private:
+    using Entry = std::pair<std::string, Value>;
+
+    void start_epoch(std::uint64_t epoch) {
+        if (epoch != epoch_) {
+            index_.clear();
+            entries_.clear();
+            epoch_ = epoch;
+        }
+    }
+
+    mutable std::mutex mutex_;
+    std::atomic<std::size_t> capacity_{0};
+    std::uint64_t epoch_ = 0;
+    std::list<Entry> entries_;
+    std::unordered_map<std::string_view, typename std::list<Entry>::iterator> index_;
+    ResultCacheStats stats_;
+    std::atomic<unsigned long long> skipped_{0};
+};
+
+// Interned strings: every distinct string is stored once and identified by a 32-bit symbol, so
+// the symbols can be stored and compared instead of the strings. The strings are kept in a
+// std::deque, which never moves them, so the lookup map can use std::string_views of them.
+class SymbolTable {
+   public:
+    using Symbol = std::uint32_t;
+    static constexpr Symbol NO_SYMBOL = std::numeric_limits<Symbol>::max();
+
+    // Returns the symbol of the string, adding it first if it isn't in the table yet
+    Symbol intern(std::string_view name);
+    // Returns the symbol of the string or NO_SYMBOL if it isn't in the table
+    Symbol find(std::string_view name) const;
+    std::string const& name(Symbol symbol) const { return names_[symbol]; }
+    std::size_t size() const { return names_.size(); }
+    void clear();
+
+   private:
+    std::deque<std::string> names_;
+    std::unordered_map<std::string_view, Symbol> symbols_;
+};
+
 class Datastructures {
    public:
     Datastructures();
@@ -96,98 +549,133 @@ class Datastructures {
 
     // Estimate of performance: O(1)
     // Short rationale for estimate: std::unordered_map::size is a constant operation.
-    unsigned int station_count();
+    unsigned int station_count() const;
 
     // Estimate of performance: O(n), 0(n)
-    // Short rationale for estimate: Two linear std::unordered_map::clear operations.
+    // Short rationale for estimate: Linear destruction of the stations, the regions, the trains and the
+    // spatial index of the stations. Their memory is given back at once by releasing the memory pools.
     void clear_all();
 
-    // Estimate of performance: O(n^2), 0(n)
-    // Short rationale for estimate: Uses a for loop. Inside the loop std::vector::push_back
-    // can in the worst case be linear if it reallocates the vector but this shouldn't happen
-    // since the vector size is reserved with std::vector::reserve which is linear by size but
-    // in this case constant since the size is 0 in the beginning.
-    std::vector<StationID> all_stations();
+    // Estimate of performance: O(n), 0(n)
+    // Short rationale for estimate: Goes through the stations once in a for loop. The vector is reserved
+    // for all of them first with std::vector::reserve, so std::vector::push_back never reallocates and
+    // is constant.
+    std::vector<StationID> all_stations() const;
 
     // Estimate of performance: O(n), 0(1)
-    // Short rationale for estimate: std::unordered_map::find and std::unordered_map::insert
-    // operations are up to linear in the worst case but on average constant operations.
+    // Short rationale for estimate: std::unordered_map::try_emplace operation, which also checks if the
+    // station already exists, is up to linear in the worst case but on average constant operation.
+    // The station is also added to the spatial index, which is rebuilt in linear time
+    // whenever the number of stations doubles, so that is amortized constant.
     bool add_station(StationID id, Name const& name, Coord xy);
 
+    // Estimate of performance: O(n), 0(1)
+    // Short rationale for estimate: Same as above, but the name is moved to the station instead of copying it.
+    bool add_station(StationID id, Name&& name, Coord xy);
+
+    // Estimate of performance: O(n * b), 0(b)
+    // Short rationale for estimate: Reserves space for the b new stations first, so std::unordered_map::insert,
+    // which also checks if the station already exists, doesn't rehash and is constant on average but linear
+    // in the worst case. The spatial index is rebuilt once in the end if the number of stations has doubled,
+    // which is linear by all of the stations but amortized constant per station.
+    unsigned int add_stations(std::vector<std::tuple<StationID, Name, Coord>> const& batch);
+
     // Estimate of performance: O(n), 0(1)
     // Short rationale for estimate: std::unordered_map::at and std::unordered_map::find operations
     // are theoretically linear in the worst case but constant on average.
-    Name get_station_name(StationID id);
+    Name get_station_name(std::string_view id) const;
 
     // Estimate of performance: O(n), 0(1)
     // Short rationale for estimate: Std::unordered_map::at and std::unordered_map::find operations
     // are theoretically linear in the worst case but constant on average.
-    Coord get_station_coordinates(StationID id);
+    Coord get_station_coordinates(std::string_view id) const;
 
-    // Estimate of performance: O(n log n)
-    // Short rationale for estimate: Uses std::vector::reserve which can be linear by size but
-    // won't affect in this method since the vector sizes are 0. Uses std::transform, which is
-    // a linear operation. Also uses std::sort, which is linearithmic operation.
-    std::vector<StationID> stations_alphabetically();
+    // Estimate of performance: O(n log n), 0(n)
+    // Short rationale for estimate: The sorted index is rebuilt with std::sort, which is linearithmic,
+    // only if stations have been added or removed since the previous call. Otherwise the
+    // StationIDs are just copied from the index in linear time.
+    std::vector<StationID> stations_alphabetically() const;
 
-    // Estimate of performance: O(n log n)
-    // Short rationale for estimate: Uses std::vector::reserve which can be linear by size but
-    // won't affect in this method since the vector sizes are 0. Uses std::transform, which is
-    // a linear operation. Also uses std::sort, which is linearithmic operation.
-    std::vector<StationID> stations_distance_increasing();
+    // Estimate of performance: O(n log n), 0(k)
+    // Short rationale for estimate: Same as above but only copies the k = count StationIDs
+    // starting from the given rank.
+    std::vector<StationID> stations_alphabetically(unsigned int first, unsigned int count) const;
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: Goes through the map in a loop.
-    StationID find_station_with_coord(Coord xy);
+    // Estimate of performance: O(n log n), 0(n)
+    // Short rationale for estimate: The sorted index is rebuilt with std::sort, which is linearithmic,
+    // only if stations have been added, removed or moved since the previous call. Otherwise the
+    // StationIDs are just copied from the index in linear time.
+    std::vector<StationID> stations_distance_increasing() const;
 
-    // Estimate of performance: O(n), 0(1)
-    // Short rationale for estimate: std::unordered_map::find operation is
-    // theoretically up to linear in the worst case but constant on average.
-    bool change_station_coord(StationID id, Coord newcoord);
+    // Estimate of performance: O(n log n), 0(k)
+    // Short rationale for estimate: Same as above but only copies the k = count StationIDs
+    // starting from the given rank.
+    std::vector<StationID> stations_distance_increasing(unsigned int first, unsigned int count) const;
 
     // Estimate of performance: O(n), 0(1)
-    // Short rationale for estimate: std::unordered_map::find, std::unordered_map::insert,
-    // std::unordered_set::find and std::unordered_set::insert operations are theoretically
-    // up to linear in the worst case but constant on average.
-    bool add_departure(StationID stationid, TrainID trainid, Time time);
+    // Short rationale for estimate: std::unordered_multimap::find on the coordinate index
+    // is theoretically up to linear in the worst case but constant on average.
+    StationID find_station_with_coord(Coord xy) const;
 
     // Estimate of performance: O(n), 0(1)
-    // Short rationale for estimate: std::unordered_map::find, std::unordered_map::erase and
-    // std::unordered_set::find operations are theoretically up to linear in the worst case but constant on average.
-    // std::unordered_set::erase is a constant operation when given the iterator position.
-    bool remove_departure(StationID stationid, TrainID trainid, Time time);
-
-    // Estimate of performance: O(n^2)
-    // Short rationale for estimate: std::unordered_map::find operation is theoretically up to
-    // linear in the worst case but constant on average. Uses a for loop which includes a
-    // std::vector::push_back which can be linear in the worst case if it reallocates. This is
-    // possible since the vector hasn't been initialized to any size. Also uses std::sort
-    // algorithm which has efficiency of linearithmic.
-    std::vector<std::pair<Time, TrainID>> station_departures_after(StationID stationid, Time time);
+    // Short rationale for estimate: std::unordered_map::find operation is
+    // theoretically up to linear in the worst case but constant on average. Moving the
+    // station in the spatial index is linear by the number of stations in its grid cell,
+    // which is constant on average.
+    bool change_station_coord(std::string_view id, Coord newcoord);
+
+    // Estimate of performance: O(n + d), 0(d)
+    // Short rationale for estimate: std::unordered_map::find is theoretically up to linear in the worst
+    // case but constant on average. The departures of the station are a sorted std::vector, so the place
+    // of the new departure is found with std::lower_bound, which is logarithmic, but std::vector::insert
+    // is linear by the number of departures d of the station.
+    bool add_departure(std::string_view stationid, TrainID trainid, Time time);
+
+    // Estimate of performance: O(n + d), 0(d)
+    // Short rationale for estimate: std::unordered_map::find is theoretically up to linear in the worst
+    // case but constant on average. Finds the departure with std::lower_bound, which is logarithmic,
+    // but std::vector::erase is linear by the number of departures d of the station.
+    bool remove_departure(std::string_view stationid, std::string_view trainid, Time time);
+
+    // Estimate of performance: O(n + log d + k), 0(log d + k)
+    // Short rationale for estimate: std::unordered_map::find is theoretically up to linear in the worst
+    // case but constant on average. The departures are already sorted, so the first one at or after the
+    // given time is found with std::lower_bound, which is logarithmic by the number of departures d, and
+    // the k found departures are copied to the result, which is linear. With the result cache enabled a
+    // cached result is only copied.
+    std::vector<std::pair<Time, TrainID>> station_departures_after(std::string_view stationid, Time time) const;
+
+    // Estimate of performance: O(n + log d + k), 0(log d + k)
+    // Short rationale for estimate: Same as above, but copies at most k = limit departures.
+    std::vector<std::pair<Time, TrainID>> station_departures_after(std::string_view stationid, Time time, unsigned int limit) const;
 
     // We recommend you implement the operations below only after implementing the ones above
 
     // Estimate of performance: O(n), 0(1)
-    // Short rationale for estimate: std::unordered_map::find is theoretically up to
-    // linear in the worst case but constant on average and that's the same for std::unordered_map::insert.
+    // Short rationale for estimate: std::unordered_map::try_emplace, which also checks if the region already
+    // exists, is theoretically up to linear in the worst case but constant on average. The coords are moved
+    // to the region.
     bool add_region(RegionID id, Name const& name, std::vector<Coord> coords);
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: Uses a for loop. Inside the loop std::vector::push_back can in the
-    // worst case be linear if it reallocates the vector but this shouldn't happen since the vector size
-    // is reserved with std::vector::reserve, which is linear by size but constant here since the size in
-    // the beginning is 0.
-    std::vector<RegionID> all_regions();
+    // Estimate of performance: O(n), 0(1)
+    // Short rationale for estimate: Same as above, but the name is moved to the region instead of copying it.
+    bool add_region(RegionID id, Name&& name, std::vector<Coord> coords);
+
+    // Estimate of performance: O(n), 0(n)
+    // Short rationale for estimate: Goes through the regions once in a for loop. The vector is reserved
+    // for all of them first with std::vector::reserve, so std::vector::push_back never reallocates and
+    // is constant.
+    std::vector<RegionID> all_regions() const;
 
     // Estimate of performance: O(n), 0(1)
     // Short rationale for estimate: std::unordered_map::find and std::unordered_map::at operation
     // are theoretically up to linear in the worst case but constant on average.
-    Name get_region_name(RegionID id);
+    Name get_region_name(RegionID id) const;
 
     // Estimate of performance: O(n), 0(1)
     // Short rationale for estimate: std::unordered_map::find and std::unordered_map::at operation
     // are theoretically up to linear in the worst case but constant on average.
-    std::vector<Coord> get_region_coords(RegionID id);
+    std::vector<Coord> get_region_coords(RegionID id) const;
 
     // Estimate of performance: O(n), 0(1)
     // Short rationale for estimate: std::unordered_map::find, std::unordered_set::find and std::unordered_set::insert
@@ -197,138 +685,1012 @@ class Datastructures {
     // Estimate of performance: O(n), 0(1)
     // Short rationale for estimate: std::unordered_map::find operation is theoretically up to linear
     // in the worst case but constant on average.
-    bool add_station_to_region(StationID id, RegionID parentid);
+    bool add_station_to_region(std::string_view id, RegionID parentid);
 
-    // Estimate of performance: O(n^2)
+    // Estimate of performance: O(n log n), 0(h)
     // Short rationale for estimate: std::unordered_map::find operation is theoretically up to linear
-    // in the worst case but constant on average. Also uses std::vector::push_back which is constant
-    // but can be linear if the vector is reallocated. This can happen since the vector size isn't initialized.
-    std::vector<RegionID> station_in_regions(StationID id);
+    // in the worst case but constant on average. Rebuilding the region tree after the regions have changed
+    // is O(n log n). Otherwise follows the parents of the region tree to the root, which is linear by the
+    // depth h of the region of the station. The result is reserved for all of them first.
+    std::vector<RegionID> station_in_regions(std::string_view id) const;
 
     // Non-compulsory operations
 
-    // Estimate of performance: O(n^2)
+    // Estimate of performance: O(n log n), 0(k)
     // Short rationale for estimate: std::unordered_map::find operation is theoretically up to linear
-    // in the worst case but constant on average. std::unordered_set::size is constant. Uses another method,
-    // which uses recursion and goes through a loop to check all subregions.
-    // This method also uses std::vector::push_back and that can be linear if it reallocates.
-    std::vector<RegionID> all_subregions_of_region(RegionID id);
+    // in the worst case but constant on average. Rebuilding the region tree after the regions have changed
+    // is O(n log n). Otherwise the k subregions are next to each other in the pre-order of the region tree
+    // and are copied to the result at once.
+    std::vector<RegionID> all_subregions_of_region(RegionID id) const;
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: Uses a loop to go through the map and does some comparisons inside it. After
-    // the loop uses std::unordered_map::empty, which is constant, std::unordered_map::size, which is also constant
-    // and std::vector_push_back which is constant but can be linear if the vector is reallocated.
-    std::vector<StationID> stations_closest_to(Coord xy);
+    // Estimate of performance: O(n log n), 0(1)
+    // Short rationale for estimate: std::unordered_map::find operation is theoretically up to linear
+    // in the worst case but constant on average. Rebuilding the region tree after the regions have changed
+    // is O(n log n). Otherwise the count is the size of the pre-order range of the region, which is constant.
+    int count_subregions_of_region(RegionID id) const;
+
+    // Estimate of performance: O(n log n + c), 0(r + k + m)
+    // Short rationale for estimate: Rebuilding the region tree after the regions have changed is O(n log n)
+    // and linear by all of the coordinates c of the regions. Otherwise goes through the bounding boxes of the
+    // r root regions and skips every subtree, whose bounding box doesn't contain the point, so only the k regions
+    // near the point are checked. Checking if a polygon contains the point is linear by its m coordinates.
+    std::vector<RegionID> regions_containing(Coord xy) const;
 
     // Estimate of performance: O(n), 0(1)
+    // Short rationale for estimate: Calls stations_closest_to with k = 3.
+    std::vector<StationID> stations_closest_to(Coord xy) const;
+
+    // Estimate of performance: O(n), 0(k log k)
+    // Short rationale for estimate: Searches the grid cells of the spatial index in rings around the
+    // given coordinate and stops when the next ring can't contain anything closer than the k:th best
+    // station. On average only a constant number of cells near the coordinate are visited. In the worst
+    // case all of the stations are in the searched cells. Keeps the best stations in a std::priority_queue
+    // and sorts them in the end with std::sort, which are logarithmic and linearithmic by k.
+    std::vector<StationID> stations_closest_to(Coord xy, unsigned int k) const;
+
+    // Estimate of performance: O(n + t * l * (s + log d)), 0(t * l * s)
     // Short rationale for estimate: std::unordered_map::find and std::unordered_map::erase
     // operations are theoretically up to linear in the worst case but constant on average.
-    bool remove_station(StationID id);
+    // Removing the station from the spatial index is constant on average. Each of the t trains stopping
+    // at the station is unlinked from its l stops, whose next stations s are searched linearly, the
+    // station is dropped from its stops and the train is linked again. At most one departure of d is
+    // removed from the new last stop of a train, which is found with binary search.
+    bool remove_station(std::string_view id);
 
-    // Estimate of performance: O(n^2), 0(n)
+    // Estimate of performance: O(n log n), 0(1)
     // Short rationale for estimate: std::unordered_map::find operation is theoretically up to linear
-    // in the worst case but constant on average. Uses a while loop, which includes std::list::push_back,
-    // which is constant. std::list::empty is also a constant operation.
-    // Uses std::find_first_of, which is linear operation.
-    RegionID common_parent_of_regions(RegionID id1, RegionID id2);
+    // in the worst case but constant on average. Rebuilding the region tree after the regions have changed
+    // is O(n log n). Otherwise the lowest common ancestor is found from the sparse table over the Euler tour
+    // of the region tree with two lookups, which is constant.
+    RegionID common_parent_of_regions(RegionID id1, RegionID id2) const;
 
-    // Estimate of performance: O(n^2), 0(n)
+    // Estimate of performance: O(s * (n + k + d)), 0(s * (k + d))
     // Short rationale for estimate: std::unordered_map::find and std::unordered_map::insert operations are
-    // theoretically up to linear in the worst case but constant on average. Uses loops, which include the
-    // add_departure-function, which is constant on average but linear in the worst case. Also uses
-    // std::list::push_back, which is constant.
+    // theoretically up to linear in the worst case but constant on average. Goes through the s stops of the
+    // train once to check them and once to add the departures, the train stops and the next stations of the
+    // stations. Adding a departure is linear by the departures d of the station and adding a next station by
+    // the next stations k of the station, which are small. The station graph is only marked to be rebuilt.
     bool add_train(TrainID trainid, std::vector<std::pair<StationID, Time>> stationtimes);
 
-    // Estimate of performance: O(n^3)
+    // Estimate of performance: O(s * (n + log d)), 0(s log d)
+    // Short rationale for estimate: Reserves space for the new trains first, so std::unordered_map::insert
+    // doesn't rehash. Like above, the lookups are linear in the worst case but constant on average. Looks up
+    // the s stops of the trains once and reserves the departures of every station. The departures are
+    // appended and each station touched is sorted once in the end, which is linearithmic by its departures d.
+    // The station graph is only marked to be rebuilt.
+    unsigned int add_trains(std::vector<std::pair<TrainID, std::vector<std::pair<StationID, Time>>>> const& batch);
+
+    // Estimate of performance: O(n), 0(k)
     // Short rationale for estimate: std::unordered_map::find operation is theoretically up to linear
-    // in the worst case but constant on average. Uses two for loops inside, which also include
-    // std::vector::push_back, which can be linear if it reallocates.
-    std::vector<StationID> next_stations_from(StationID id);
+    // in the worst case but constant on average. The next stations are kept up to date by add_train,
+    // so the k next stations are just copied to the result.
+    std::vector<StationID> next_stations_from(std::string_view id) const;
 
-    // Estimate of performance: O(n^2)
-    // Short rationale for estimate: std::unordered_map::find and std::unordered_set::find operations
-    // are theoretically up to linear in the worst case but constant on average. Uses for loops, which
-    // also include std::vector::push_back, which can be linear if it reallocates.
-    std::vector<StationID> train_stations_from(StationID stationid, TrainID trainid);
+    // Estimate of performance: O(n), 0(log d + k)
+    // Short rationale for estimate: std::unordered_map::find operations are theoretically up to linear in
+    // the worst case but constant on average. The stop position of the train at the station is found from
+    // the trains of the station, the departure with std::binary_search, which is logarithmic by the departures
+    // d of the station, and the k remaining stops of the train are copied to the result.
+    std::vector<StationID> train_stations_from(std::string_view stationid, std::string_view trainid) const;
 
-    // Estimate of performance: O(n), 0(n)
-    // Short rationale for estimate: Linear std::unordered_map::clear operation.
+    // Estimate of performance: O(n + d), 0(n + d)
+    // Short rationale for estimate: Linear destruction of the trains, whose memory is given back at once
+    // by releasing their memory pool. Also clears the trains and the next stations of every station and
+    // removes the departures of the trains from all of the d departures of the stations.
     void clear_trains();
 
-    // Estimate of performance: O(n^2)
+    // Estimate of performance: O(n + s * (k + d)), 0(s * (k + log d))
+    // Short rationale for estimate: std::unordered_map::find and std::unordered_map::erase operations are
+    // theoretically up to linear in the worst case but constant on average. Each of the s stops of the train
+    // loses the train from its trains and next stations k and its departure, which is found with binary search
+    // by the departures d of the station and erased, linear by d. The station graph is only marked to be rebuilt.
+    bool remove_train(std::string_view trainid);
+
+    // Estimate of performance: O(n + s * (k + d) + m), 0(s * (k + log d))
+    // Short rationale for estimate: Like remove_train and add_train for the same train. When the stops stay the
+    // same and only the times change, the station graph isn't rebuilt: each of the s - 1 connections of the
+    // train is found with binary search and moved to its new place, which is linear by the number of
+    // connections between its old and new time, up to all of the m connections.
+    bool update_train_times(std::string_view trainid, std::vector<std::pair<StationID, Time>> const& stationtimes);
+
+    // The route searches below run over a compressed sparse row graph of the stations (dense indexes of
+    // the stations and one array of edges sorted by the departure times). The first search after trains or
+    // stations have been changed rebuilds the graph, which is O(n + e log e) by stations n and edges e, one
+    // edge per consecutive stops of a train. The estimates below don't include the rebuild.
+    // Only new times of a train with the same stops are updated to the graph in place.
+    // The state of a search is kept in a pooled search context, which is reset in constant time, so the
+    // searches don't modify the stations and can be run from many threads at the same time, as long as
+    // no other operation is run at the same time.
+
+    // Estimate of performance: O(n + e), 0(n + e)
+    // Short rationale for estimate: std::unordered_map::find operation is theoretically up to linear
+    // in the worst case but constant on average. Resetting the search context is constant.
+    // Uses BFS, which visits every station and edge at most once. The BFS queue is a std::vector of the
+    // search context, whose memory is reused, so std::vector::push_back is amortized constant. Also uses
+    // std::reverse, which is linear by the length of the route.
+    std::vector<std::pair<StationID, Distance>> route_any(std::string_view fromid, std::string_view toid) const;
+
+    // Estimate of performance: O(n + e), 0(n + e)
     // Short rationale for estimate: std::unordered_map::find operation is theoretically up to linear
-    // in the worst case but constant on average. Uses BFS, which is linear. Includes loop, which has
-    // std::vector::push_back, which can be linear if it reallocates. Uses also std::queue::push,
-    // std::queue::pop, std::queue::front and std::queue::empty, which are all constant operations.
-    // Also uses std::reverse, which is linear operation.
-    std::vector<std::pair<StationID, Distance>> route_any(StationID fromid, StationID toid);
+    // in the worst case but constant on average. Resetting the search context is constant.
+    // Uses BFS, which visits every station and edge at most once. The BFS queue is a std::vector of the
+    // search context, whose memory is reused, so std::vector::push_back is amortized constant. Also uses
+    // std::reverse, which is linear by the length of the route. With the result cache enabled a cached
+    // route is only copied, which is linear by its length.
+    std::vector<std::pair<StationID, Distance>> route_least_stations(std::string_view fromid, std::string_view toid) const;
 
-    // Estimate of performance: O(n^2)
+    // Estimate of performance: O(n + e), 0(n + e)
     // Short rationale for estimate: std::unordered_map::find operation is theoretically up to linear
-    // in the worst case but constant on average. Uses BFS, which is linear. Includes loop, which has
-    // std::vector::push_back, which can be linear if it reallocates. Uses also std::queue::push,
-    // std::queue::pop, std::queue::front and std::queue::empty, which are all constant operations.
-    // Also uses std::reverse, which is linear operation.
-    std::vector<std::pair<StationID, Distance>> route_least_stations(StationID fromid, StationID toid);
+    // in the worst case but constant on average. Resetting the search context is constant.
+    // Uses DFS, which expands every station once and pushes at most one entry per edge. The DFS stack is
+    // a std::vector of the search context, whose memory is reused, so std::vector::push_back is amortized
+    // constant. Also uses std::reverse, which is linear by the length of the route.
+    std::vector<StationID> route_with_cycle(std::string_view fromid) const;
+
+    // Estimate of performance: O((n + e) log n), 0((n + e) log n)
+    // Short rationale for estimate: std::unordered_map::find operation is theoretically up to linear
+    // in the worst case but constant on average. Resetting the search context is constant.
+    // Uses A-star-algorithm, which settles every station once and relaxes every edge at most once.
+    // The open set is a QuaternaryHeap, whose push and pop are logarithmic. Its memory is reused between calls.
+    // Also uses std::reverse, which is linear by the length of the route. With an up-to-date contraction hierarchy only the few
+    // arcs upwards in the hierarchy from both of the stations are searched instead. With the result cache
+    // enabled a cached route is only copied, which is linear by its length.
+    std::vector<std::pair<StationID, Distance>> route_shortest_distance(std::string_view fromid, std::string_view toid) const;
+
+    // Estimate of performance: O(o * e log n / t), 0(o * e' log n / t)
+    // Short rationale for estimate: Runs one Dijkstra-algorithm per origin over the e edges of the graph, which
+    // stops after all of the destinations are found, so usually only the e' edges closer than the furthest one
+    // are relaxed. The o origins are shared between t threads, each with its own search context from the pool.
+    std::vector<Distance> distance_matrix(std::vector<StationID> const& origins, std::vector<StationID> const& destinations) const;
+
+    // Estimate of performance: O(q * (n + e) log n / t), 0(q * (n + e) log n / t)
+    // Short rationale for estimate: Runs each of the q queries like route_least_stations, route_shortest_distance
+    // or route_earliest_arrival on the t workers of the pool. Every worker reuses one search context for all of
+    // its queries, so no memory is allocated for the searches after the first batch.
+    std::vector<RouteQueryResult> route_queries(std::vector<RouteQuery> const& queries) const;
 
-    // Estimate of performance: O(n^2)
+    // Estimate of performance: O(n + e), 0(log e + e')
     // Short rationale for estimate: std::unordered_map::find operation is theoretically up to linear
-    // in the worst case but constant on average. Uses DFS, which is linear. Includes loop, which has
-    // std::vector::push_back, which can be linear if it reallocates. Uses also std::stack::push,
-    // std::stack::pop, std::stack::top and std::stack::empty, which are all constant operations.
-    // Also uses std::reverse, which is linear operation.
-    std::vector<StationID> route_with_cycle(StationID fromid);
+    // in the worst case but constant on average. Resetting the search context is constant.
+    // With TimetableEngine::dijkstra, the default, uses Dijkstra-algorithm, which settles every station once
+    // and relaxes every edge at most once. The open set is a RadixHeap, whose push is constant and pop
+    // amortized constant, since the times are 16-bit and an entry moves down at most through its 17 buckets.
+    // Its memory is reused between calls. With TimetableEngine::connection_scan finds the first connection
+    // departing at the starttime with std::lower_bound, which is logarithmic by the connections e, one per
+    // edge, and scans the e' connections departing before the arrival to the end station once.
+    std::vector<std::pair<StationID, Time>> route_earliest_arrival(std::string_view fromid, std::string_view toid, Time starttime) const;
 
-    // Estimate of performance: O(n^2)
+    // Estimate of performance: O(n + e log e), 0(e log p)
     // Short rationale for estimate: std::unordered_map::find operation is theoretically up to linear
-    // in the worst case but constant on average. Uses A-star-algorithm, which is on its own is O(n log n).
-    // Includes loop, which has std::vector::push_back, which can be linear if it reallocates. Uses also
-    // std::set::insert and std::set::find, which are logarithmic. Uses std::set::erase, which is amortized contant.
-    // Also uses std::reverse, which is a linear algorithm.
-    std::vector<std::pair<StationID, Distance>> route_shortest_distance(StationID fromid, StationID toid);
+    // in the worst case but constant on average. Scans the e connections departing at the begintime or
+    // later once backwards and finds the best continuation at the next station of a connection with a
+    // binary search over the p journeys kept at that station, which are at most all of the connections.
+    // Building each route is linear by its length.
+    std::vector<std::vector<std::pair<StationID, Time>>> route_earliest_arrival_profile(std::string_view fromid, std::string_view toid,
+                                                                                        Time begintime, Time endtime) const;
 
-    // Estimate of performance: O(n^2)
+    // Estimate of performance: O(n + m log m + k * m log t), 0(k * m' log t)
     // Short rationale for estimate: std::unordered_map::find operation is theoretically up to linear
-    // in the worst case but constant on average. Uses Dijkstra-algorithm, which is on its own O(n log n).
-    // Uses std::list::push_back and std::vector::reserve, which are constant operations. Uses also
-    // std::set::insert and std::set::find, which are logarithmic. Uses std::set::erase, which is amortized contant.
-    std::vector<std::pair<StationID, Time>> route_earliest_arrival(StationID fromid, StationID toid, Time starttime);
+    // in the worst case but constant on average. After the trains have changed they are grouped to routes,
+    // which sorts the m stops of the trains. Each of the k rounds scans the routes through the stations improved
+    // in the previous round once from the first such station, at most all of the m stops, and finds the earliest
+    // train to take at a stop with a binary search over the t trains of the route. Usually only the m' stops
+    // of the routes near the journeys found are scanned. Building each journey is linear by its length.
+    std::vector<TransferJourney> route_earliest_arrival_transfers(std::string_view fromid, std::string_view toid, Time starttime) const;
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: Only sets the engine used by route_earliest_arrival, which is
+    // TimetableEngine::dijkstra until set otherwise.
+    // Must not be called at the same time with the route searches.
+    void set_timetable_engine(TimetableEngine engine);
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: Only returns the engine used by route_earliest_arrival.
+    TimetableEngine timetable_engine() const;
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: Only sets the direction used by route_least_stations and route_shortest_distance.
+    // Must not be called at the same time with the route searches.
+    void set_search_direction(SearchDirection direction);
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: Only returns the direction used by route_least_stations and route_shortest_distance.
+    SearchDirection search_direction() const;
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: Only sets whether route_shortest_distance uses the contraction hierarchy and starts
+    // building it in the background. Must not be called at the same time with the route searches.
+    void set_contraction_hierarchy(bool enabled);
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: Only compares the version of the hierarchy to the version of the graph. Starts
+    // building a new hierarchy in the background if it isn't up to date, which doesn't wait for the building.
+    bool contraction_hierarchy_ready() const;
+
+    // Estimate of performance: O(n), 0(1)
+    // Short rationale for estimate: Sets how many results of each of route_least_stations, route_shortest_distance
+    // and station_departures_after are kept, 0 to disable the cache. Dropping the results over a smaller capacity
+    // is linear.
+    void set_result_cache(std::size_t capacity);
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: Only adds up the counters of the caches.
+    ResultCacheStats result_cache_stats() const;
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: Only copies the counters. Counting costs two reads of the steady clock and a few
+    // relaxed atomic additions per call of an operation and adding up the counters of a search when its context is
+    // given back to the pool, so it can be left on under load. A published copy counts the calls made to it in its
+    // own stats().
+    DatastructuresStats stats() const;
+
+    // Estimate of performance: O(n + e log e), 0(n + e)
+    // Short rationale for estimate: Writes the stations, the regions and the trains with their departures and
+    // stops and the graph of the stations once to a buffer, which is linear. The buffer is written with one call.
+    // Building the graph first, if it has been marked dirty, takes O(n + e log e) because of sorting the edges.
+    bool save_snapshot(std::string const& path) const;
+
+    // Estimate of performance: O(n^2 + s^2 + e), 0(n + s + e)
+    // Short rationale for estimate: Maps the file to memory, but doesn't use the records in place. Every record is
+    // copied out of the mapping, which is unmapped before returning. Each of the n symbols, stations, regions and
+    // trains is inserted to a hash map, which is constant on average but linear in the worst case. The departures
+    // are copied and each of the s stops of the trains is linked to the train stops and the next stations of its
+    // station again, which is a hash insert and a scan of the few next stations. The e edges of the graph are
+    // copied as they are, so the graph isn't sorted, and only its reverse edges are built again.
+    bool load_snapshot(std::string const& path);
+
+    // Readers on other threads query the latest published copy of the data instead of this object, so this one
+    // can be changed at the same time. A published copy is never changed, so any number of threads can use its
+    // const functions at once, and it is freed when the last reader lets go of it. Its lazily built indexes are
+    // built before it is published and it shares the threads of this object instead of starting its own, so while
+    // this object exists neither querying nor freeing a copy waits for a rebuild or a thread. It gets the
+    // contraction hierarchy of this object, if it is ready, and otherwise searches without one. The queries of a
+    // copy don't wait for a lock held by another thread either: the search contexts are borrowed with atomic
+    // operations, the result cache is skipped while another thread uses it and a batch of distance_matrix or
+    // route_queries runs on the calling thread while the shared threads run another batch.
+
+    // Estimate of performance: O(n^2 + s^2 + e log e + t log t), 0(n log n + s + e + t log t)
+    // Short rationale for estimate: Copies all of the data through a snapshot image in memory like save_snapshot
+    // and load_snapshot, so the graph is copied as it is. Sorting the stations by name and by distance and
+    // grouping the t trains to routes for the copy are linearithmic, and the region tree is built like in
+    // station_in_regions. The contraction hierarchy is shared, not copied. Replacing the published copy is constant.
+    // Nothing is shared with the previous copy, so every call costs a full copy even after a small change. It is
+    // meant for publishing after a batch of changes, not for a writer applying a feed of single changes like
+    // train delays, which should publish only every so often.
+    bool publish();
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: Only copies the shared pointer of the latest copy published, which doesn't
+    // wait for publish(). nullptr before the first publish().
+    std::shared_ptr<Datastructures const> published() const;
 
    private:
+    // Dense index of a station, which isn't in station_index
+    static constexpr std::uint32_t NO_INDEX = std::numeric_limits<std::uint32_t>::max();
+
+    struct Train;
+
     struct Region {
         RegionID id = NO_REGION;
         Name name = NO_NAME;
         std::vector<Coord> coordinates;
         RegionID parent = NO_REGION;
-        std::unordered_set<RegionID> subregions;
+        std::pmr::unordered_set<RegionID> subregions;
+        // Dense index in the RegionTree, set when current_region_tree() rebuilds it
+        mutable std::uint32_t index = NO_INDEX;
+
+        // Allocator-aware, so the regions map gives its memory resource to subregions
+        using allocator_type = std::pmr::polymorphic_allocator<char>;
+        explicit Region(allocator_type alloc = {}) : subregions(alloc) {}
     };
 
+    // Bounding box of a polygon or of the polygons of a subtree of regions, empty if lower > upper
+    struct RegionBox {
+        Coord lower = {std::numeric_limits<int>::max(), std::numeric_limits<int>::max()};
+        Coord upper = {std::numeric_limits<int>::min(), std::numeric_limits<int>::min()};
+
+        void extend(RegionBox const& other) {
+            lower = {std::min(lower.x, other.lower.x), std::min(lower.y, other.lower.y)};
+            upper = {std::max(upper.x, other.upper.x), std::max(upper.y, other.upper.y)};
+        }
+        bool contains(Coord xy) const {
+            return lower.x <= xy.x && xy.x <= upper.x && lower.y <= xy.y && xy.y <= upper.y;
+        }
+    };
+
+    // Ancestor index of the regions by their dense indexes. The Euler tour lists the regions in the order
+    // a depth-first search over the region forest visits them, and sparse[j][i] is the region with the
+    // smallest depth in euler[i] ... euler[i + 2^j - 1], so the lowest common ancestor of two regions is
+    // found with two lookups. The subregions of region i are preorder[tin[i] + 1] ... preorder[tout[i] - 1].
+    // Regions in a cycle of parents aren't in any tree and have no root.
+    struct RegionTree {
+        std::vector<Region const*> regions;
+        std::vector<std::uint32_t> parent;
+        std::vector<std::uint32_t> depth;
+        std::vector<std::uint32_t> root;
+        std::vector<std::uint32_t> first;
+        std::vector<std::vector<std::uint32_t>> sparse;
+        std::vector<RegionID> preorder;
+        std::vector<std::uint32_t> tin;
+        std::vector<std::uint32_t> tout;
+        // Subregions of region i are children[child_offsets[i]] ... children[child_offsets[i + 1] - 1]
+        std::vector<std::uint32_t> child_offsets;
+        std::vector<std::uint32_t> children;
+        // Bounding boxes of the polygons by dense index and of the subtrees by pre-order position
+        std::vector<RegionBox> boxes;
+        std::vector<RegionBox> subtree_boxes;
+        std::vector<std::uint32_t> preorder_index;
+        // Regions in a cycle of parents, which aren't in the pre-order
+        std::vector<std::uint32_t> unrooted;
+    };
+
+    // Symbols of the TrainIDs leaving a station, sorted by the time and then by the TrainID
+    using Departures = std::pmr::vector<std::pair<Time, SymbolTable::Symbol>>;
+
     struct Station {
-        StationID id = NO_STATION;
+        // Symbol of the StationID in symbols
+        SymbolTable::Symbol id = SymbolTable::NO_SYMBOL;
         Name name = NO_NAME;
         Coord location = NO_COORD;
         RegionID region = NO_REGION;
-        std::unordered_map<Time, std::unordered_set<TrainID>> departures;
-        std::list<std::pair<Time, std::pair<Time, Station*>>> stations_to;
-        unsigned short color;
-        Distance d;
-        Distance de;
-        Station* pi = nullptr;
+        Departures departures;
+        std::uint32_t index = NO_INDEX;
+        // Trains stopping at the station and the (first) position of the station in their stationtimes
+        std::pmr::unordered_map<Train const*, std::size_t> train_stops;
+        // Next stops of the trains leaving the station, each once with the number of such trains
+        std::pmr::vector<std::pair<Station*, unsigned int>> next_stations;
+
+        // Allocator-aware, so the stations map gives its memory resource to the containers above
+        using allocator_type = std::pmr::polymorphic_allocator<char>;
+        explicit Station(allocator_type alloc = {}) : departures(alloc), train_stops(alloc), next_stations(alloc) {}
     };
 
+    // The stationtimes of a train as the stations and the times at them
     struct Train {
-        TrainID id = NO_TRAIN;
-        std::vector<std::pair<StationID, Time>> stationtimes;
+        // Symbol of the TrainID in symbols
+        SymbolTable::Symbol id = SymbolTable::NO_SYMBOL;
+        std::pmr::vector<Station*> stops;
+        std::pmr::vector<Time> times;
+
+        using allocator_type = std::pmr::polymorphic_allocator<char>;
+        explicit Train(allocator_type alloc = {}) : stops(alloc), times(alloc) {}
+    };
+
+    // A train connection from one station to the next stop of the train
+    struct Edge {
+        Time departure;
+        Time arrival;
+        std::uint32_t to;
+        Distance length;
+    };
+
+    // A train connection for the connection scan, which also knows the station it leaves from
+    struct Connection {
+        Time departure;
+        Time arrival;
+        std::uint32_t from;
+        std::uint32_t to;
+    };
+
+    // Adjacency of the stations in compressed sparse row form built from the trains: the edges leaving
+    // station i are edges[offsets[i]] ... edges[offsets[i + 1] - 1] sorted by departure time. The same
+    // connections are also kept in one array sorted by departure time for the connection scan.
+    // The reverse edges are the same edges by the station they arrive at, each with the station it
+    // leaves from in to, for the backward half of the bidirectional searches.
+    struct Graph {
+        std::vector<std::uint32_t> offsets;
+        std::vector<Edge> edges;
+        std::vector<Coord> coords;
+        std::vector<Connection> connections;
+        std::vector<std::uint32_t> reverse_offsets;
+        std::vector<Edge> reverse_edges;
+    };
+
+    struct HierarchyArc {
+        std::uint32_t to;
+        Distance length;
+    };
+
+    // Contraction hierarchy of the distances of a graph. The stations are contracted one by one and the shortcuts
+    // keep the distances between the remaining stations, so a route goes first up and then down in the order of
+    // contraction. up has, in rows like Graph, the arcs from each station to the ones contracted later and down
+    // the arcs to each station from the ones contracted later, with the station they come from in to.
+    struct ContractionHierarchy {
+        // graph_version of the graph it was built from
+        std::uint64_t version = 0;
+        std::vector<std::uint32_t> up_offsets;
+        std::vector<HierarchyArc> up;
+        std::vector<std::uint32_t> down_offsets;
+        std::vector<HierarchyArc> down;
+        // The station between the ends of every shortcut, keyed by from << 32 | to
+        std::unordered_map<std::uint64_t, std::uint32_t> shortcuts;
+    };
+
+    // Position of a station on a route of TransitRoutes
+    struct RouteStop {
+        std::uint32_t route;
+        std::uint32_t position;
+    };
+
+    // Stops from begin to end of a train, whose times increase, taken as a trip of TransitRoutes
+    struct TrainSegment {
+        Train const* train;
+        std::uint32_t begin;
+        std::uint32_t end;
+    };
+
+    // Trains grouped to routes for route_earliest_arrival_transfers. A train reaching a stop over midnight or in no
+    // time is split there to two trips, since like in the other engines it isn't taken to that stop. The trips of
+    // a route have the same stops and none of them overtakes another, so they are in the same order by the time at
+    // every stop.
+    struct TransitRoutes {
+        // mutation_epoch of the trains it was built from
+        std::uint64_t epoch = 0;
+        // Dense indexes of the stations of route r are in stops from stop_offsets[r] to stop_offsets[r + 1]
+        std::vector<std::uint32_t> stop_offsets;
+        std::vector<std::uint32_t> stops;
+        // Trips of route r are from trip_offsets[r] to trip_offsets[r + 1]. Their trains are in trip_trains and
+        // their times at the stops of the route start from times[time_offsets[trip]].
+        std::vector<std::uint32_t> trip_offsets;
+        std::vector<SymbolTable::Symbol> trip_trains;
+        std::vector<std::uint32_t> time_offsets;
+        std::vector<Time> times;
+        // Routes through station i are in station_routes from station_offsets[i] to station_offsets[i + 1]
+        std::vector<std::uint32_t> station_offsets;
+        std::vector<RouteStop> station_routes;
+    };
+
+    // Arrival to a station in a round of route_earliest_arrival_transfers with the trip taken from the board position
+    // of its route to the alight position. previous is the earlier arrival to the same station in an earlier round.
+    struct TransferStep {
+        Time arrival;
+        std::uint32_t round;
+        std::uint32_t route;
+        std::uint32_t trip;
+        std::uint32_t board;
+        std::uint32_t alight;
+        std::uint32_t previous;
     };
 
-    std::unordered_map<StationID, Station> stations;
-    std::unordered_map<RegionID, Region> regions;
-    std::unordered_map<TrainID, Train> trains;
+    // Search state of one station, valid only if its generation is the generation of the search
+    struct Label {
+        std::uint32_t generation = 0;
+        unsigned short color = 0;
+        Distance d = 999999;
+        Distance de = 999999;
+        std::uint32_t pi = NO_INDEX;
+        // Connection the station was reached with in the connection scan
+        std::uint32_t via = NO_INDEX;
+    };
 
-    Distance distance_between_points(Coord a, Coord b);
-    void regions_recursively(std::vector<RegionID>& result, std::unordered_map<RegionID, Region>::iterator it);
-    void relax_astar(Station* u, Station* v, Station* g);
-    void relax_dijkstra(Station* u, Station* v, Time& u_depart, Time& at_v);
+    // Journey from a station to the end station of a profile search, which departs with the given connection.
+    // The journeys of a station are kept in decreasing departure and arrival time.
+    struct ProfileEntry {
+        Time departure;
+        Time arrival;
+        std::uint32_t via;
+    };
+
+    // Work of the searches of one search context, added to search_stats when the context is given back to the pool.
+    // Empty with DATASTRUCTURES_STATS 0, so counting compiles to nothing.
+    struct SearchCounters {
+#if DATASTRUCTURES_STATS
+        SearchStats stats;
+        void start() { stats.searches++; }
+        void settle() { stats.settled++; }
+        void relax() { stats.relaxed++; }
+        void push(bool queued) {
+            stats.pushes++;
+            stats.decrease_keys += queued;
+        }
+        void reset_label() { stats.labels_reset++; }
+        void sweep(std::size_t labels) {
+            stats.reset_sweeps++;
+            stats.labels_reset += labels;
+        }
+#else
+        void start() {}
+        void settle() {}
+        void relax() {}
+        void push(bool) {}
+        void reset_label() {}
+        void sweep(std::size_t) {}
+#endif
+    };
+
+    // State of one route search. Starting a new generation makes all of the labels outdated,
+    // so resetting doesn't need to go through the stations.
+    struct SearchContext {
+        std::vector<Label> labels;
+        std::uint32_t generation = 0;
+        std::vector<std::uint32_t> frontier;
+        FifoQueue<Distance, std::uint32_t> station_queue;
+        QuaternaryHeap<Distance, std::uint32_t> distance_queue;
+        // Labels, frontier and queue of the backward half of a bidirectional search, in which pi is the next station
+        std::vector<Label> reverse_labels;
+        std::vector<std::uint32_t> reverse_frontier;
+        QuaternaryHeap<Distance, std::uint32_t> reverse_distance_queue;
+        RadixHeap<std::uint32_t> time_queue;
+        std::vector<std::vector<ProfileEntry>> profiles;
+        // First position to scan on every route of TransitRoutes in a round, NO_INDEX if the route isn't scanned.
+        // Set back to NO_INDEX after the route has been scanned, so it is never reset.
+        std::vector<std::uint32_t> route_positions;
+        std::vector<TransferStep> transfer_steps;
+        SearchCounters counters;
+
+        void reset(std::size_t n);
+        std::vector<ProfileEntry>& profile(std::uint32_t i);
+
+        Label& label(std::uint32_t i) {
+            Label& l = labels[i];
+            if (l.generation != generation) {
+                l = Label{};
+                l.generation = generation;
+                counters.reset_label();
+            }
+            return l;
+        }
+
+        Label& reverse_label(std::uint32_t i) {
+            Label& l = reverse_labels[i];
+            if (l.generation != generation) {
+                l = Label{};
+                l.generation = generation;
+                counters.reset_label();
+            }
+            return l;
+        }
+    };
+
+    // Policies of search_graph for the route searches. A policy gives at compile time:
+    //   Queue, the open set, and queue(search), which returns it from the search context
+    //   start(label), which sets the label of the start station and returns its key
+    //   relax(search, graph, u, lu, lv, edge), which improves the label lv of edge.to through u, whose label is lu,
+    //   and returns true if it did
+    //   key(label), the key of an improved station in the queue, such as its cost with a heuristic added
+    //   closed(u), which is true to stop the search when station u is closed
+    //   reached(v), which is true to stop the search as soon as station v is improved
+
+    // Breadth-first search by the number of stations like route_least_stations, the distance travelled in de
+    struct LeastStationsPolicy {
+        using Queue = FifoQueue<Distance, std::uint32_t>;
+        std::uint32_t g;
+
+        static Queue& queue(SearchContext& search) { return search.station_queue; }
+        static Distance start(Label& ls) {
+            ls.d = 0;
+            ls.de = 0;
+            return 0;
+        }
+        static bool relax(SearchContext&, Graph const&, std::uint32_t u, Label const& lu, Label& lv, Edge const& e) {
+            if (lv.color != 0) {
+                return false;
+            }
+            lv.d = lu.d + 1;
+            lv.de = lu.de + e.length;
+            lv.pi = u;
+            return true;
+        }
+        static Distance key(Label const& l) { return l.d; }
+        bool closed(std::uint32_t) const { return false; }
+        bool reached(std::uint32_t v) const { return v == g; }
+    };
+
+    // Breadth-first search to any route like route_any, the distance travelled in d
+    struct AnyRoutePolicy : LeastStationsPolicy {
+        static Distance start(Label& ls) {
+            ls.d = 0;
+            return 0;
+        }
+        static bool relax(SearchContext&, Graph const&, std::uint32_t u, Label const& lu, Label& lv, Edge const& e) {
+            if (lv.color != 0) {
+                return false;
+            }
+            lv.d = lu.d + e.length;
+            lv.pi = u;
+            return true;
+        }
+    };
+
+    // A-star-algorithm by the distances like route_shortest_distance, the distance with the estimate to g in de
+    struct ShortestDistancePolicy {
+        using Queue = QuaternaryHeap<Distance, std::uint32_t>;
+        std::uint32_t g;
+
+        static Queue& queue(SearchContext& search) { return search.distance_queue; }
+        static Distance start(Label& ls) {
+            ls.d = 0;
+            return 0;
+        }
+        bool relax(SearchContext& search, Graph const& graph, std::uint32_t u, Label const&, Label const& lv, Edge const& e) const {
+            Distance de = lv.de;
+            relax_astar(search, graph, u, e, g);
+            return lv.de < de;
+        }
+        static Distance key(Label const& l) { return l.de; }
+        bool closed(std::uint32_t u) const { return u == g; }
+        bool reached(std::uint32_t) const { return false; }
+    };
+
+    // Dijkstra-algorithm by the distances until all of the targets are closed like distance_matrix
+    struct TargetsPolicy {
+        using Queue = QuaternaryHeap<Distance, std::uint32_t>;
+        std::vector<char> const& is_target;
+        std::size_t targets;
+
+        static Queue& queue(SearchContext& search) { return search.distance_queue; }
+        static Distance start(Label& ls) {
+            ls.d = 0;
+            return 0;
+        }
+        static bool relax(SearchContext&, Graph const&, std::uint32_t u, Label const& lu, Label& lv, Edge const& e) {
+            Distance d = lu.d + e.length;
+            if (lv.d <= d) {
+                return false;
+            }
+            lv.d = d;
+            lv.pi = u;
+            return true;
+        }
+        static Distance key(Label const& l) { return l.d; }
+        bool closed(std::uint32_t u) { return is_target[u] && --targets == 0; }
+        bool reached(std::uint32_t) const { return false; }
+    };
+
+    // Dijkstra-algorithm by the arrival times like route_earliest_arrival with TimetableEngine::dijkstra
+    struct EarliestArrivalPolicy {
+        using Queue = RadixHeap<std::uint32_t>;
+        std::uint32_t g;
+        Time starttime;
+
+        static Queue& queue(SearchContext& search) { return search.time_queue; }
+        Time start(Label& ls) const {
+            ls.d = starttime;
+            return starttime;
+        }
+        static bool relax(SearchContext& search, Graph const&, std::uint32_t u, Label const&, Label const& lv, Edge const& e) {
+            Distance d = lv.d;
+            relax_dijkstra(search, u, e);
+            return lv.d < d;
+        }
+        static Time key(Label const& l) { return l.d; }
+        bool closed(std::uint32_t u) const { return u == g; }
+        bool reached(std::uint32_t) const { return false; }
+    };
+
+    // Borrows a SearchContext from search_pool for the lifetime of the object
+    class PooledSearch {
+       public:
+        explicit PooledSearch(Datastructures const& owner);
+        ~PooledSearch();
+        PooledSearch(PooledSearch const&) = delete;
+        PooledSearch& operator=(PooledSearch const&) = delete;
+
+        SearchContext* operator->() { return context_.get(); }
+        SearchContext& operator*() { return *context_; }
+
+       private:
+        Datastructures const& owner_;
+        std::unique_ptr<SearchContext> context_;
+    };
+
+    // Counts a call of an operation and its latency to stats() when it goes out of scope
+    class OperationTimer {
+       public:
+#if DATASTRUCTURES_STATS
+        OperationTimer(Datastructures const& owner, StatsOperation operation);
+        ~OperationTimer();
+#else
+        OperationTimer(Datastructures const&, StatsOperation) {}
+#endif
+        OperationTimer(OperationTimer const&) = delete;
+        OperationTimer& operator=(OperationTimer const&) = delete;
+
+#if DATASTRUCTURES_STATS
+       private:
+        Datastructures const& owner_;
+        StatsOperation operation_;
+        std::chrono::steady_clock::time_point start_;
+#endif
+    };
+
+    // Calls of an operation counted with relaxed atomic operations
+    struct OperationCounters {
+        std::atomic<unsigned long long> calls{0};
+        std::atomic<unsigned long long> total_nanoseconds{0};
+        std::array<std::atomic<unsigned long long>, OperationStats::LATENCY_BUCKETS> latency{};
+    };
+
+    // Work of all of the route searches added up with relaxed atomic operations
+    struct SearchTotals {
+        std::atomic<unsigned long long> searches{0};
+        std::atomic<unsigned long long> settled{0};
+        std::atomic<unsigned long long> relaxed{0};
+        std::atomic<unsigned long long> pushes{0};
+        std::atomic<unsigned long long> decrease_keys{0};
+        std::atomic<unsigned long long> labels_reset{0};
+        std::atomic<unsigned long long> reset_sweeps{0};
+    };
+
+    // Stations of one cell of the spatial index, coordinates stored as separate
+    // arrays for squared_distances()
+    struct GridCell {
+        std::vector<int> xs;
+        std::vector<int> ys;
+        std::vector<Station*> stations;
+    };
+
+    // Binary snapshot written by save_snapshot(). The file starts with a SnapshotHeader, which is followed by
+    // the sections in the order of the counts of the header, each padded to a multiple of 8 bytes. The records
+    // refer to each other only with indexes and the strings are offsets to the string section at the end, so
+    // the file can be mapped to any address. Integers are in the byte order of the machine, which is checked.
+    static constexpr std::uint32_t SNAPSHOT_VERSION = 1;
+    static constexpr std::uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+    struct SnapshotHeader {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t byte_order;
+        std::uint64_t symbols;
+        std::uint64_t stations;
+        std::uint64_t departures;
+        std::uint64_t regions;
+        std::uint64_t region_coords;
+        std::uint64_t trains;
+        std::uint64_t stops;
+        // The graph has stations + 1 offsets and as many connections as edges
+        std::uint64_t edges;
+        std::uint64_t string_bytes;
+    };
+
+    struct SnapshotString {
+        std::uint64_t offset;
+        std::uint64_t length;
+    };
+
+    // Stations in the order of their dense indexes, each followed in the departures section by its departures
+    struct SnapshotStation {
+        SymbolTable::Symbol id;
+        std::uint32_t departures;
+        SnapshotString name;
+        Coord location;
+        RegionID region;
+    };
+
+    struct SnapshotDeparture {
+        Time time;
+        std::uint16_t unused;
+        SymbolTable::Symbol train;
+    };
+
+    // Each region is followed by its coordinates in the region coordinates section
+    struct SnapshotRegion {
+        RegionID id;
+        RegionID parent;
+        SnapshotString name;
+        std::uint64_t coords;
+    };
+
+    // Each train is followed by its stops in the stops section
+    struct SnapshotTrain {
+        SymbolTable::Symbol id;
+        std::uint32_t stops;
+    };
+
+    struct SnapshotStop {
+        std::uint32_t station;
+        Time time;
+        std::uint16_t unused;
+    };
+
+    // StationIDs and TrainIDs, and every TrainID of a departure. The symbols aren't removed with
+    // the stations and the trains, only by clear_all.
+    SymbolTable symbols;
+
+    // Memory of the stations and the regions, and of the trains, with everything inside them. The pools
+    // reuse the memory of removed entries and clear_all and clear_trains give it all back with release().
+    // Declared before the containers, which must be destroyed first.
+    std::pmr::unsynchronized_pool_resource station_memory;
+    std::pmr::unsynchronized_pool_resource train_memory;
+
+    // Keyed by the symbols of the IDs, searched with find_station() and find_train()
+    using StationMap = std::pmr::unordered_map<SymbolTable::Symbol, Station>;
+    using TrainMap = std::pmr::unordered_map<SymbolTable::Symbol, Train>;
+    using RegionMap = std::pmr::unordered_map<RegionID, Region>;
+
+    StationMap stations{&station_memory};
+    RegionMap regions{&station_memory};
+    TrainMap trains{&train_memory};
+
+    // Spatial index of the stations: exact coordinates and a uniform grid of cells,
+    // whose size is chosen in rebuild_station_grid()
+    std::unordered_multimap<Coord, Station*, CoordHash> stations_by_coord;
+    std::unordered_map<Coord, GridCell, CoordHash> station_grid;
+    int grid_cell_size = 1024;
+    Coord grid_min = NO_COORD;
+    Coord grid_max = NO_COORD;
+    std::size_t grid_rebuild_at = 64;
+
+    // Stations sorted by name and by distance from (0, 0), rebuilt when marked dirty. Like the graph, they are
+    // rebuilt by the first reader, which finds them dirty, under index_mutex, and the others wait for it.
+    mutable std::vector<Station const*> stations_by_name;
+    mutable std::vector<Station const*> stations_by_distance;
+    mutable std::atomic<bool> stations_by_name_dirty{false};
+    mutable std::atomic<bool> stations_by_distance_dirty{false};
+
+    // Rebuilt by current_region_tree() when marked dirty, under index_mutex too
+    mutable RegionTree region_tree;
+    mutable std::atomic<bool> region_tree_dirty{false};
+    mutable std::mutex index_mutex;
+
+    // Dense indexes of the stations: station_index[i]->index == i. Removing a station
+    // moves the last station to its index.
+    std::vector<Station*> station_index;
+
+    // Rebuilt by current_graph() when marked dirty
+    mutable Graph graph;
+    mutable std::atomic<bool> graph_dirty{true};
+    mutable std::mutex graph_mutex;
+    // Increased under graph_mutex whenever the graph changes
+    mutable std::atomic<std::uint64_t> graph_version{0};
+
+    TimetableEngine engine = TimetableEngine::dijkstra;
+    SearchDirection direction = SearchDirection::forward;
+
+    // Increased by every change, which can change the result of a cached query
+    std::uint64_t mutation_epoch = 0;
+    mutable LruCache<std::vector<std::pair<StationID, Distance>>> route_cache;
+    mutable LruCache<std::vector<std::pair<Time, TrainID>>> departure_cache;
+
+    // The latest copy made by publish(), read with std::atomic_load and replaced with std::atomic_store
+    std::shared_ptr<Datastructures const> published_state;
+
+    // Search contexts, which aren't in use by any search at the moment. A search takes the context of the first
+    // full slot with an atomic exchange and gives it back to the first empty slot with a compare-exchange, so
+    // borrowing a context never waits for another thread. A search finding every slot empty creates a new context
+    // and one finding every slot full deletes its context.
+    static constexpr std::size_t SEARCH_POOL_SLOTS = 64;
+    mutable std::array<std::atomic<SearchContext*>, SEARCH_POOL_SLOTS> search_pool{};
+
+    // Counters of stats(). The search counters of a context are added to search_stats when the context is given
+    // back to the pool.
+    mutable std::array<OperationCounters, (std::size_t)StatsOperation::count> operation_stats;
+    mutable SearchTotals search_stats;
+
+    // Threads of distance_matrix and route_queries, started by worker_pool() when first needed. A published copy
+    // shares the pool of the Datastructures it was published from.
+    mutable std::once_flag workers_started;
+    mutable std::shared_ptr<WorkStealingPool> workers;
+
+    // Contraction hierarchy of route_shortest_distance, when enabled. hierarchy_builder builds it from a copy of
+    // the graph, while the searches keep using A-star-algorithm, and replaces it under hierarchy_mutex when ready.
+    bool hierarchy_enabled = false;
+    mutable std::mutex hierarchy_mutex;
+    mutable std::shared_ptr<ContractionHierarchy const> hierarchy;
+    mutable std::thread hierarchy_builder;
+    mutable bool hierarchy_building = false;
+    mutable std::uint64_t hierarchy_wanted = 0;
+    mutable std::atomic<bool> hierarchy_stopping{false};
+    // Set for a copy made by publish(), which only uses the hierarchy it was given and never starts hierarchy_builder
+    bool published_copy = false;
+
+    // Routes of route_earliest_arrival_transfers, built by current_transit() when first needed after a change
+    mutable std::mutex transit_mutex;
+    mutable std::shared_ptr<TransitRoutes const> transit;
+
+    void clear_data();
+    bool insert_station(StationID&& id, Name&& name, Coord xy);
+    bool insert_region(RegionID id, Name&& name, std::vector<Coord>&& coords);
+    StationMap::iterator find_station(std::string_view id);
+    StationMap::const_iterator find_station(std::string_view id) const;
+    TrainMap::iterator find_train(std::string_view id);
+    TrainMap::const_iterator find_train(std::string_view id) const;
+    static std::string cache_key(char kind, std::string_view fromid, std::string_view toid, std::uint64_t number);
+    static Distance distance_between_points(Coord a, Coord b);
+    Coord grid_cell(Coord xy) const;
+    void index_station(Station* station);
+    void unindex_station(Station* station);
+    void rebuild_station_grid();
+    std::vector<Station const*> const& sorted_by_name() const;
+    std::vector<Station const*> const& sorted_by_distance() const;
+    std::vector<StationID> station_ids(std::vector<Station const*> const& sorted, unsigned int first, unsigned int count) const;
+    RegionTree const& current_region_tree() const;
+    static bool polygon_contains(std::vector<Coord> const& polygon, Coord xy);
+    std::vector<RegionID> subregions_in_cycle(RegionTree const& tree, std::uint32_t i) const;
+    static void relax_astar(SearchContext& search, Graph const& graph, std::uint32_t u, Edge const& e, std::uint32_t g);
+    static void relax_dijkstra(SearchContext& search, std::uint32_t u, Edge const& e);
+    template <typename Policy>
+    static void search_graph(SearchContext& search, Graph const& graph, std::uint32_t s, Policy& policy);
+    std::vector<std::pair<StationID, Distance>> labelled_route(SearchContext& search, std::uint32_t g, Distance Label::*cost) const;
+    std::vector<std::pair<StationID, Distance>> least_stations_route(SearchContext& search, std::string_view fromid,
+                                                                     std::string_view toid) const;
+    std::vector<std::pair<StationID, Distance>> shortest_distance_route(SearchContext& search, std::string_view fromid,
+                                                                        std::string_view toid) const;
+    std::vector<std::pair<StationID, Time>> earliest_arrival_route(SearchContext& search, std::string_view fromid, std::string_view toid,
+                                                                   Time starttime) const;
+    std::vector<std::pair<StationID, Distance>> least_stations_bidirectional(SearchContext& search, Graph const& graph, std::uint32_t s,
+                                                                             std::uint32_t g) const;
+    std::vector<std::pair<StationID, Distance>> shortest_distance_bidirectional(SearchContext& search, Graph const& graph, std::uint32_t s,
+                                                                                std::uint32_t g) const;
+    std::vector<std::pair<StationID, Distance>> route_through(SearchContext& search, Graph const& graph, std::uint32_t u,
+                                                              std::uint32_t v) const;
+    static void build_reverse_edges(Graph& graph);
+    std::shared_ptr<ContractionHierarchy const> current_hierarchy() const;
+    void build_hierarchies() const;
+    static std::shared_ptr<ContractionHierarchy> contract_graph(std::vector<std::uint32_t> const& offsets, std::vector<Edge> const& edges,
+                                                                std::atomic<bool> const& stopping);
+    std::vector<std::pair<StationID, Distance>> shortest_distance_hierarchy(SearchContext& search, ContractionHierarchy const& ch,
+                                                                            Graph const& graph, std::uint32_t s, std::uint32_t g) const;
+    static void unpack_shortcut(ContractionHierarchy const& ch, std::uint32_t from, std::uint32_t to, std::vector<std::uint32_t>& route);
+    WorkStealingPool& worker_pool() const;
+    void distances_from(SearchContext& search, Graph const& graph, std::uint32_t s, std::vector<char> const& is_target,
+                        std::size_t targets) const;
+    std::vector<std::pair<StationID, Time>> earliest_arrival_dijkstra(SearchContext& search, Graph const& graph, std::uint32_t s,
+                                                                      std::uint32_t g, Time starttime) const;
+    std::vector<std::pair<StationID, Time>> earliest_arrival_connection_scan(SearchContext& search, Graph const& graph, std::uint32_t s,
+                                                                             std::uint32_t g, Time starttime) const;
+    std::shared_ptr<TransitRoutes const> current_transit() const;
+    std::vector<TransferJourney> transfer_journeys(SearchContext& search, TransitRoutes const& routes, std::uint32_t g) const;
+    Graph const& current_graph() const;
+    bool insert_departure(Station& station, SymbolTable::Symbol trainid, Time time);
+    Departures::const_iterator find_departure(
+        Departures const& departures, Time time, SymbolTable::Symbol trainid) const;
+    bool departure_less(std::pair<Time, SymbolTable::Symbol> a, std::pair<Time, SymbolTable::Symbol> b) const;
+    bool find_stops(std::vector<std::pair<StationID, Time>> const& stationtimes, std::vector<Station*>& stops);
+    static void link_train(Train const& train);
+    static void unlink_train(Train const& train);
+    void remove_train_departures(Train const& train);
+    void retime_graph(Train const& train, std::pmr::vector<Time> const& old_times);
+    std::vector<char> snapshot_image() const;
+    static void append_snapshot_section(std::vector<char>& image, void const* data, std::size_t bytes);
+    bool load_snapshot_image(char const* image, std::size_t size);
 };
 
+/**
+ * @brief Datastructures::search_graph searches the graph from a station, closing the stations in the order of their
+ *        keys in the queue of the policy. Outdated entries of closed stations are skipped, so a station is pushed again
+ *        instead of decreasing its key. Defined here, so every policy is compiled in and its functions inlined.
+ * @param search the reset SearchContext of the search, which has the labels of the stations in the end
+ * @param graph the up-to-date Graph
+ * @param s dense index of the start station
+ * @param policy the policy of the search
+ */
+template <typename Policy>
+void Datastructures::search_graph(SearchContext& search, Graph const& graph, std::uint32_t s, Policy& policy) {
+    typename Policy::Queue& queue = policy.queue(search);
+    Label& ls = search.label(s);
+    ls.color = 1;
+    queue.push(policy.start(ls), s);
+    search.counters.push(false);
+
+    while (!queue.empty()) {
+        std::uint32_t u = queue.pop().second;
+        Label& lu = search.label(u);
+        if (lu.color == 2) {
+            continue;
+        }
+        lu.color = 2;
+        search.counters.settle();
+        if (policy.closed(u)) {
+            return;
+        }
+        for (std::uint32_t e = graph.offsets[u]; e < graph.offsets[u + 1]; e++) {
+            Edge const& edge = graph.edges[e];
+            search.counters.relax();
+            Label& lv = search.label(edge.to);
+            if (lv.color == 2) {
+                continue;
+            }
+            if (policy.relax(search, graph, u, lu, lv, edge)) {
+                search.counters.push(lv.color == 1);
+                lv.color = 1;
+                queue.push(policy.key(lv), edge.to);
+                if (policy.reached(edge.to)) {
+                    return;
+                }
+            }
+        }
+    }
+}
+
 #endif